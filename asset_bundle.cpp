@@ -0,0 +1,96 @@
+#include "asset_bundle.hpp"
+
+#include <iostream>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+bool AssetBundle::load(std::string const &filename) {
+	header = nullptr;
+	texels = nullptr;
+	storage.clear();
+	if (!file.open(filename)) return false;
+	return use(file.data, file.size, filename);
+}
+
+bool AssetBundle::load(std::string const &filename, uint64_t source_hash) {
+	header = nullptr;
+	texels = nullptr;
+	storage.clear();
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0) return false;
+	if (!file.open(filename)) return false;
+	if (file.size < sizeof(BundleHeader) || memcmp(file.data, "SBND", 4) != 0
+		|| reinterpret_cast< BundleHeader const * >(file.data)->source_hash != source_hash) {
+		file.close();
+		return false;
+	}
+	return use(file.data, file.size, filename);
+}
+
+bool AssetBundle::load(std::vector< uint32_t > &&bytes, std::string const &label) {
+	header = nullptr;
+	texels = nullptr;
+	file.close();
+	storage = std::move(bytes);
+	return use(reinterpret_cast< char const * >(storage.data()), storage.size() * 4, label);
+}
+
+bool AssetBundle::use(char const *data, size_t size, std::string const &label) {
+	auto fail = [&](char const *why) {
+		std::cerr << "Bundle '" << label << "' " << why << "." << std::endl;
+		file.close();
+		storage.clear();
+		return false;
+	};
+	if (size < sizeof(BundleHeader)) return fail("is too small");
+	BundleHeader const *h = reinterpret_cast< BundleHeader const * >(data);
+	if (memcmp(h->magic, "SBND", 4) != 0) return fail("is not an asset bundle");
+	if (h->version != BUNDLE_VERSION) return fail("has an unsupported version");
+	if (h->texels_offset % 4 != 0 || h->atlas_offset % 4 != 0) return fail("has misaligned sections");
+	if (uint64_t(h->width) * uint64_t(h->height) * 4 != h->texels_size) return fail("has the wrong amount of texel data");
+	if (h->texels_offset > size || h->texels_size > size - h->texels_offset) return fail("has truncated texels");
+	if (h->atlas_offset > size || h->atlas_size > size - h->atlas_offset) return fail("has a truncated sprite table");
+
+	if (!atlas.load(data + h->atlas_offset, h->atlas_size, label)) {
+		file.close();
+		storage.clear();
+		return false;
+	}
+	if (atlas.header->width != h->width || atlas.header->height != h->height) return fail("has a sprite table for a different texture size");
+
+#ifndef _WIN32
+	//the texels are about to be read front-to-back by the upload; start paging them in now:
+	if (file.mapped()) {
+		char const *page = data + (h->texels_offset / BUNDLE_TEXEL_ALIGNMENT) * BUNDLE_TEXEL_ALIGNMENT;
+		madvise(const_cast< char * >(page), h->texels_size + (data + h->texels_offset - page), MADV_WILLNEED);
+	}
+#endif
+
+	header = h;
+	texels = reinterpret_cast< uint32_t const * >(data + h->texels_offset);
+	return true;
+}
+
+void make_bundle(uint32_t width, uint32_t height, uint32_t const *texels, char const *atlas, size_t atlas_size, uint64_t source_hash, std::vector< uint32_t > *bundle) {
+	BundleHeader header;
+	memcpy(header.magic, "SBND", 4);
+	header.version = BUNDLE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.texels_offset = BUNDLE_TEXEL_ALIGNMENT;
+	header.texels_size = width * height * 4;
+	header.atlas_offset = header.texels_offset + header.texels_size; //already 4-byte aligned
+	header.atlas_size = uint32_t(atlas_size);
+	header.source_hash = source_hash;
+
+	bundle->assign((size_t(header.atlas_offset) + atlas_size + 3) / 4, 0);
+	char *out = reinterpret_cast< char * >(bundle->data());
+	memcpy(out, &header, sizeof(header));
+	memcpy(out + header.texels_offset, texels, header.texels_size);
+	memcpy(out + header.atlas_offset, atlas, atlas_size);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "sprite_atlas.hpp"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Cooked asset bundle (".bundle"), made by cook_bundle from an atlas PNG and its .atlas table.
+ * Layout (little-endian):
+ *   BundleHeader
+ *   texels at texels_offset (page-aligned): width * height RGBA8 pixels, lower-left origin,
+ *     rows tightly packed -- exactly what glTexImage2D(..., GL_RGBA, GL_UNSIGNED_BYTE, ...) wants
+ *   sprite table at atlas_offset (4-byte aligned): the bytes of a .atlas file (see sprite_atlas.hpp)
+ * Nothing needs decoding at load time, so the bundle is mapped and handed straight to GL.
+ * source_hash identifies the files the bundle was cooked from (see asset_cache.hpp), so a bundle
+ * can be checked against the current sources without decoding them.
+ */
+
+struct BundleHeader {
+	char magic[4]; //"SBND"
+	uint32_t version;
+	uint32_t width, height; //texture size, in pixels
+	uint32_t texels_offset;
+	uint32_t texels_size;
+	uint32_t atlas_offset;
+	uint32_t atlas_size;
+	uint64_t source_hash; //asset_source_hash() of the texture and sprite table; 0 if unknown
+};
+static_assert(sizeof(BundleHeader) == 40, "BundleHeader is packed as in the file.");
+
+#define BUNDLE_VERSION 2
+#define BUNDLE_TEXEL_ALIGNMENT 4096
+
+struct AssetBundle {
+	//map (or read) and validate 'filename'; returns false (with a message on stderr) on failure:
+	bool load(std::string const &filename);
+	//the same, but only if 'filename' exists and its header says it was cooked from sources with 'source_hash'
+	//(quietly false otherwise, before anything past the header is looked at):
+	bool load(std::string const &filename, uint64_t source_hash);
+	//validate and use bundle bytes made in memory (e.g. by make_bundle); 'label' is only used in error messages:
+	bool load(std::vector< uint32_t > &&bytes, std::string const &label);
+
+	BundleHeader const *header = nullptr;
+	uint32_t const *texels = nullptr; //header->width * header->height pixels
+	SpriteAtlas atlas; //refers into the bundle
+
+private:
+	bool use(char const *data, size_t size, std::string const &label);
+	MappedFile file;
+	std::vector< uint32_t > storage; //bytes given to load(), if not from a file
+};
+
+//lay out a bundle of 'texels' (width * height RGBA8 pixels, lower-left origin) and the bytes of a .atlas file:
+void make_bundle(uint32_t width, uint32_t height, uint32_t const *texels, char const *atlas, size_t atlas_size, uint64_t source_hash, std::vector< uint32_t > *bundle);
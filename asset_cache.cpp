@@ -0,0 +1,126 @@
+#include "asset_cache.hpp"
+#include "asset_io.hpp"
+#include "load_save_qoi.hpp"
+#include "mapped_file.hpp"
+#include "sprite_atlas.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+//64-bit FNV-1a (sprite_hash()'s 32-bit version, widened):
+static void fnv1a(uint64_t *hash, void const *data, size_t size) {
+	uint8_t const *at = reinterpret_cast< uint8_t const * >(data);
+	uint64_t h = *hash;
+	for (size_t i = 0; i < size; ++i) {
+		h = (h ^ at[i]) * 1099511628211ull;
+	}
+	*hash = h;
+}
+
+//(sizes too, so bytes can't slide from one file to the next and hash the same)
+static uint64_t file_hash(char const *data, size_t size) {
+	uint64_t h = 14695981039346656037ull;
+	uint64_t size64 = size;
+	fnv1a(&h, &size64, sizeof(size64));
+	fnv1a(&h, data, size);
+	return h;
+}
+
+static uint64_t source_hash(uint64_t const *file_hashes, size_t count) {
+	uint64_t h = 14695981039346656037ull;
+	uint32_t versions[2] = {ASSET_COOK_VERSION, BUNDLE_VERSION};
+	fnv1a(&h, versions, sizeof(versions));
+	fnv1a(&h, file_hashes, count * sizeof(uint64_t));
+	return h;
+}
+
+bool asset_source_hash(std::vector< std::string > const &filenames, uint64_t *hash) {
+	std::vector< uint64_t > file_hashes;
+	for (auto const &filename : filenames) {
+		MappedFile file;
+		if (!file.open(filename)) return false;
+		file_hashes.emplace_back(file_hash(file.data, file.size));
+	}
+	*hash = source_hash(file_hashes.data(), file_hashes.size());
+	return true;
+}
+
+bool load_cached_bundle(std::string const &texture, std::string const &sprites, std::string const &cache_dir, std::string const &prebuilt, AssetBundle *bundle, bool *hit) {
+	if (hit) *hit = false;
+
+	//one batch of reads (see asset_io.hpp) for both sources, each hashed as soon as it's in:
+	AssetReads reads;
+	uint64_t file_hashes[2] = {0, 0};
+	AssetRead &texture_read = reads.add(texture, [&file_hashes](AssetRead &read){
+		if (read.ok) file_hashes[0] = file_hash(reinterpret_cast< char const * >(read.bytes.data()), read.size);
+	});
+	AssetRead &sprites_read = reads.add(sprites, [&file_hashes](AssetRead &read){
+		if (read.ok) file_hashes[1] = file_hash(reinterpret_cast< char const * >(read.bytes.data()), read.size);
+	});
+	reads.run();
+	if (!texture_read.ok || !sprites_read.ok) return false;
+	uint64_t hash = source_hash(file_hashes, 2);
+
+	//a bundle cooked from them is mapped, not read (the texels go straight from the page cache to GL):
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bundle", (unsigned long long)hash);
+	std::string cached = cache_dir + "/" + name;
+	if ((prebuilt != "" && bundle->load(prebuilt, hash)) || bundle->load(cached, hash)) {
+		if (hit) *hit = true;
+		return true;
+	}
+
+	//cook, from the bytes already read:
+	unsigned int width = 0, height = 0;
+	std::vector< uint32_t > texels;
+	if (!load_image(texture_read.bytes.data(), texture_read.size, &width, &height, &texels, LowerLeftOrigin)) {
+		std::cerr << "Failed to load '" << texture << "'." << std::endl;
+		return false;
+	}
+	char const *sprites_data = reinterpret_cast< char const * >(sprites_read.bytes.data());
+	SpriteAtlas atlas;
+	if (sprites_read.size >= 4 && memcmp(sprites_data, "SPAT", 4) == 0) {
+		if (!atlas.load(sprites_data, sprites_read.size, sprites)) return false;
+		if (atlas.header->width != width || atlas.header->height != height) {
+			std::cerr << "'" << sprites << "' is for a " << atlas.header->width << "x" << atlas.header->height
+				<< " texture, but '" << texture << "' is " << width << "x" << height << "." << std::endl;
+			return false;
+		}
+	} else {
+		//the old spriteBin.bin, normalized for this texture:
+		if (!atlas.load_sprite_bin(sprites_data, sprites_read.size, sprites, width, height)) return false;
+	}
+	std::vector< uint32_t > bytes;
+	make_bundle(width, height, texels.data(), reinterpret_cast< char const * >(atlas.header),
+		atlas.header->strings_offset + atlas.header->strings_size, hash, &bytes);
+	std::vector< uint32_t >().swap(texels);
+
+	//store it (written aside and renamed into place, so a half-written entry is never seen):
+	#ifdef _WIN32
+	_mkdir(cache_dir.c_str());
+	#else
+	mkdir(cache_dir.c_str(), 0755);
+	#endif
+	std::string temp = cached + ".tmp";
+	bool written;
+	{
+		std::ofstream out(temp, std::ios::binary);
+		out.write(reinterpret_cast< char const * >(bytes.data()), bytes.size() * 4);
+		written = bool(out.flush());
+	}
+	if (written && std::rename(temp.c_str(), cached.c_str()) == 0) {
+		std::cout << "Cooked '" << texture << "' and '" << sprites << "' into '" << cached << "'." << std::endl;
+	} else {
+		std::cerr << "NOTE: couldn't write '" << cached << "'; cooked assets won't be cached." << std::endl;
+		std::remove(temp.c_str());
+	}
+
+	return bundle->load(std::move(bytes), cached);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "asset_bundle.hpp"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Cooked-asset cache.
+ * A texture (PNG or QOI) and its sprite table (.atlas, or the old spriteBin.bin, converted) are cooked
+ * into an asset bundle (see asset_bundle.hpp) that is stored as <cache dir>/<source hash>.bundle, where
+ * the hash covers both files' bytes and ASSET_COOK_VERSION. A launch with the same sources as last time
+ * then just reads that bundle: no decoding or conversion at all. Changing either file (or the cooker) gives
+ * a new hash, and so a fresh cook; old entries are left for whoever cleans up the cache directory.
+ */
+
+//bump when cooking would make something different from the same sources:
+#define ASSET_COOK_VERSION 1
+
+//hash of the bytes of each of 'filenames' (in order), along with ASSET_COOK_VERSION and BUNDLE_VERSION;
+//false (with a message on stderr) if a file can't be read:
+bool asset_source_hash(std::vector< std::string > const &filenames, uint64_t *hash);
+
+//load the bundle cooked from 'texture' and 'sprites': read from 'cache_dir' -- or from 'prebuilt' (e.g.
+//one made by cook_bundle), if that was cooked from the same sources -- when there is one; otherwise
+//cooked now and written to 'cache_dir' for next time. The sources are read in one batch (see asset_io.hpp);
+//a matching bundle is mapped.
+//'hit' (if given) is set to whether cooking was skipped.
+//False if the sources can't be read or don't go together:
+bool load_cached_bundle(std::string const &texture, std::string const &sprites, std::string const &cache_dir, std::string const &prebuilt, AssetBundle *bundle, bool *hit = nullptr);
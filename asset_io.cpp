@@ -0,0 +1,408 @@
+#include "asset_io.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#define ASSET_IO_URING
+#endif
+#endif
+
+AssetRead &AssetReads::add(std::string const &filename, std::function< void(AssetRead &) > const &on_read) {
+	reads.emplace_back();
+	reads.back().filename = filename;
+	callbacks.emplace_back(on_read);
+	return reads.back();
+}
+
+bool AssetReads::run() {
+	bool ok = true;
+	if (first_new < reads.size()) {
+		if (use_io_uring && run_io_uring(&ok)) {
+			backend = "io_uring";
+		} else {
+			backend = "pread";
+			ok = run_pread();
+		}
+	}
+	first_new = reads.size();
+	return ok;
+}
+
+//---- thread pool ----
+
+#ifndef _WIN32
+//open and size 'read', leaving its buffer allocated; returns the file descriptor, or -1:
+static int open_read(AssetRead &read) {
+	int fd = ::open(read.filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		std::cerr << "Failed to open '" << read.filename << "'." << std::endl;
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		std::cerr << "Failed to stat '" << read.filename << "'." << std::endl;
+		::close(fd);
+		return -1;
+	}
+	read.size = size_t(st.st_size);
+	read.bytes.assign((read.size + 3) / 4, 0);
+	return fd;
+}
+
+//read all of an open_read() file into its buffer; false if it couldn't be:
+static bool pread_all(int fd, AssetRead &read) {
+	char *to = reinterpret_cast< char * >(read.bytes.data());
+	size_t got = 0;
+	while (got < read.size) {
+		ssize_t ret = pread(fd, to + got, read.size - got, off_t(got));
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) break;
+		got += size_t(ret);
+	}
+	return got == read.size;
+}
+#endif
+
+bool AssetReads::run_pread() {
+	std::atomic< size_t > next(first_new);
+	std::atomic< bool > all_ok(true);
+	auto worker = [&]() {
+		while (true) {
+			size_t i = next++;
+			if (i >= reads.size()) break;
+			AssetRead &read = reads[i];
+#ifndef _WIN32
+			int fd = open_read(read);
+			if (fd >= 0) {
+				read.ok = pread_all(fd, read);
+				::close(fd);
+				if (!read.ok) std::cerr << "Failed to read '" << read.filename << "'." << std::endl;
+			}
+#else
+			std::ifstream file(read.filename, std::ios::binary);
+			if (file) {
+				file.seekg(0, std::ios::end);
+				read.size = size_t(file.tellg());
+				file.seekg(0, std::ios::beg);
+				read.bytes.assign((read.size + 3) / 4, 0);
+				read.ok = bool(file.read(reinterpret_cast< char * >(read.bytes.data()), read.size));
+			}
+			if (!read.ok) std::cerr << "Failed to read '" << read.filename << "'." << std::endl;
+#endif
+			if (!read.ok) all_ok = false;
+			if (callbacks[i]) callbacks[i](read);
+		}
+	};
+	std::vector< std::thread > pool;
+	size_t count = std::min< size_t >(ASSET_IO_THREADS, reads.size() - first_new);
+	for (size_t i = 1; i < count; ++i) {
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (auto &thread : pool) {
+		thread.join();
+	}
+	return all_ok;
+}
+
+//---- io_uring ----
+
+#ifdef ASSET_IO_URING
+
+namespace {
+//just enough of an io_uring (set up by hand, as liburing would) for a batch of reads:
+struct Ring {
+	~Ring() {
+		if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+		if (cq_ring != MAP_FAILED) munmap(cq_ring, cq_ring_size);
+		if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+		if (fd >= 0) ::close(fd);
+	}
+
+	bool setup(unsigned entries) {
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		fd = int(syscall(__NR_io_uring_setup, entries, &params));
+		if (fd < 0) return false;
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		//(mapped separately, which every kernel accepts, whether or not it could share one mapping)
+		sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) return false;
+
+		char *sq = reinterpret_cast< char * >(sq_ring);
+		sq_head = reinterpret_cast< unsigned * >(sq + params.sq_off.head);
+		sq_tail = reinterpret_cast< unsigned * >(sq + params.sq_off.tail);
+		sq_mask = *reinterpret_cast< unsigned * >(sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast< unsigned * >(sq + params.sq_off.array);
+		sq_entries = params.sq_entries;
+		char *cq = reinterpret_cast< char * >(cq_ring);
+		cq_head = reinterpret_cast< unsigned * >(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast< unsigned * >(cq + params.cq_off.tail);
+		cq_mask = *reinterpret_cast< unsigned * >(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast< io_uring_cqe * >(cq + params.cq_off.cqes);
+		tail = *sq_tail;
+		return true;
+	}
+
+	//next free submission entry (zeroed), or nullptr if the queue is full:
+	io_uring_sqe *get() {
+		if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) return nullptr;
+		unsigned index = tail & sq_mask;
+		sq_array[index] = index;
+		io_uring_sqe *sqe = reinterpret_cast< io_uring_sqe * >(sqes) + index;
+		memset(sqe, 0, sizeof(*sqe));
+		tail += 1;
+		unsubmitted += 1;
+		return sqe;
+	}
+
+	//submit what get() handed out, then wait for at least one completion:
+	bool submit_and_wait() {
+		__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+		while (true) {
+			int ret = int(syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+			if (ret >= 0) {
+				unsubmitted -= std::min(unsubmitted, unsigned(ret));
+				return true;
+			}
+			if (errno != EINTR) return false;
+		}
+	}
+
+	//after a failed submit, take back the entries the kernel never picked up; returns how many there were:
+	unsigned retract() {
+		unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+		unsigned dropped = tail - head;
+		tail = head;
+		__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+		unsubmitted = 0;
+		return dropped;
+	}
+
+	//wait for at least one completion, submitting nothing (briefly retrying if the kernel is short of resources):
+	bool wait() {
+		for (uint32_t tries = 0; tries < 1000; ++tries) {
+			int ret = int(syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+			if (ret >= 0) return true;
+			if (errno == EAGAIN || errno == EBUSY) usleep(1000);
+			else if (errno != EINTR) return false;
+		}
+		return false;
+	}
+
+	int fd = -1;
+	void *sq_ring = MAP_FAILED, *cq_ring = MAP_FAILED, *sqes = MAP_FAILED;
+	size_t sq_ring_size = 0, cq_ring_size = 0, sqes_size = 0;
+	unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr;
+	unsigned sq_mask = 0, sq_entries = 0;
+	unsigned *cq_head = nullptr, *cq_tail = nullptr;
+	unsigned cq_mask = 0;
+	io_uring_cqe *cqes = nullptr;
+	unsigned tail = 0; //local copy of *sq_tail, published by submit_and_wait()
+	unsigned unsubmitted = 0;
+};
+}
+
+bool AssetReads::run_io_uring(bool *ok) {
+	Ring ring;
+	if (!ring.setup(ASSET_IO_QUEUE_DEPTH)) {
+		static bool noted = false;
+		if (!noted) {
+			std::cerr << "NOTE: io_uring unavailable (" << strerror(errno) << "); reading assets on a thread pool instead." << std::endl;
+			noted = true;
+		}
+		return false;
+	}
+	*ok = true;
+
+	//open everything and size its buffer:
+	struct File {
+		int fd = -1;
+		bool opened = false;
+		uint32_t outstanding = 0; //pieces not yet read
+		int buffer_index = -1; //in the registered buffers
+		bool failed = false;
+	};
+	std::vector< File > files(reads.size());
+	std::vector< size_t > finished; //reads to hand to their callbacks
+	for (size_t i = first_new; i < reads.size(); ++i) {
+		files[i].fd = open_read(reads[i]);
+		files[i].opened = (files[i].fd >= 0);
+		if (!files[i].opened) files[i].failed = true;
+		if (files[i].failed || reads[i].size == 0) finished.emplace_back(i);
+	}
+
+	//register the buffers, so the kernel doesn't have to map them for every read (this can fail, e.g.
+	//over RLIMIT_MEMLOCK on older kernels, or for buffers over 1 GiB; then reads just aren't "fixed"):
+	std::vector< iovec > buffers;
+	bool oversized = false;
+	for (size_t i = first_new; i < reads.size(); ++i) {
+		if (files[i].fd < 0 || reads[i].size == 0) continue;
+		if (reads[i].size > (size_t(1) << 30)) oversized = true;
+		files[i].buffer_index = int(buffers.size());
+		iovec buffer;
+		buffer.iov_base = reads[i].bytes.data();
+		buffer.iov_len = reads[i].bytes.size() * 4;
+		buffers.emplace_back(buffer);
+	}
+	bool fixed = !buffers.empty() && !oversized && buffers.size() <= 1024
+		&& syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, buffers.data(), unsigned(buffers.size())) == 0;
+
+	//split each file into pieces:
+	struct Piece {
+		size_t file;
+		uint64_t offset;
+		uint32_t length;
+		iovec vec; //(for non-fixed reads, which take an iovec that must live until they complete)
+	};
+	std::vector< Piece > pieces;
+	for (size_t i = first_new; i < reads.size(); ++i) {
+		if (files[i].fd < 0) continue;
+		for (size_t offset = 0; offset < reads[i].size; offset += ASSET_IO_CHUNK) {
+			Piece piece;
+			piece.file = i;
+			piece.offset = offset;
+			piece.length = uint32_t(std::min< size_t >(ASSET_IO_CHUNK, reads[i].size - offset));
+			pieces.emplace_back(piece);
+			files[i].outstanding += 1;
+		}
+	}
+	std::deque< size_t > pending;
+	for (size_t p = 0; p < pieces.size(); ++p) {
+		pending.emplace_back(p);
+	}
+
+	auto finish = [&](size_t i) {
+		if (files[i].fd >= 0) ::close(files[i].fd);
+		files[i].fd = -1;
+		AssetRead &read = reads[i];
+		read.ok = !files[i].failed;
+		if (!read.ok) {
+			*ok = false;
+			if (files[i].opened) std::cerr << "Failed to read '" << read.filename << "'." << std::endl; //(open_read() reported the rest)
+		}
+		if (callbacks[i]) callbacks[i](read);
+	};
+	for (size_t i : finished) {
+		finish(i);
+	}
+
+	uint32_t in_flight = 0;
+	while (!pending.empty() || in_flight) {
+		//keep the queue full:
+		while (!pending.empty() && in_flight < ring.sq_entries) {
+			io_uring_sqe *sqe = ring.get();
+			if (!sqe) break;
+			Piece &piece = pieces[pending.front()];
+			pending.pop_front();
+			char *to = reinterpret_cast< char * >(reads[piece.file].bytes.data()) + piece.offset;
+			sqe->fd = files[piece.file].fd;
+			sqe->off = piece.offset;
+			sqe->user_data = uint64_t(&piece - pieces.data());
+			if (fixed) {
+				sqe->opcode = IORING_OP_READ_FIXED;
+				sqe->addr = uint64_t(uintptr_t(to));
+				sqe->len = piece.length;
+				sqe->buf_index = uint16_t(files[piece.file].buffer_index);
+			} else {
+				piece.vec.iov_base = to;
+				piece.vec.iov_len = piece.length;
+				sqe->opcode = IORING_OP_READV;
+				sqe->addr = uint64_t(uintptr_t(&piece.vec));
+				sqe->len = 1;
+			}
+			in_flight += 1;
+		}
+		if (!ring.submit_and_wait()) {
+			//the kernel may still be reading into the buffers, so nothing is handed over (or freed) until the
+			//reads it took have completed; then whatever isn't finished is read again with pread():
+			std::cerr << "NOTE: io_uring_enter failed (" << strerror(errno) << "); finishing the reads with pread()." << std::endl;
+			in_flight -= ring.retract();
+			bool drained = true;
+			while (in_flight) {
+				if (!ring.wait()) {
+					drained = false;
+					break;
+				}
+				unsigned cq_tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+				in_flight -= cq_tail - *ring.cq_head;
+				__atomic_store_n(ring.cq_head, cq_tail, __ATOMIC_RELEASE);
+			}
+			for (size_t i = first_new; i < reads.size(); ++i) {
+				if (!files[i].outstanding) continue;
+				files[i].outstanding = 0;
+				if (drained) {
+					files[i].failed = !pread_all(files[i].fd, reads[i]);
+				} else {
+					//(reads may still land in this buffer after we return, so it's left to them rather than freed)
+					new std::vector< uint32_t >(std::move(reads[i].bytes));
+					reads[i].bytes.clear();
+					files[i].failed = true;
+				}
+				finish(i);
+			}
+			return true;
+		}
+
+		//collect completions:
+		finished.clear();
+		unsigned head = *ring.cq_head;
+		unsigned cq_tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != cq_tail; ++head) {
+			io_uring_cqe const &cqe = ring.cqes[head & ring.cq_mask];
+			Piece &piece = pieces[size_t(cqe.user_data)];
+			File &file = files[piece.file];
+			in_flight -= 1;
+			if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+				pending.emplace_back(size_t(cqe.user_data));
+				continue;
+			}
+			if (cqe.res > 0 && uint32_t(cqe.res) < piece.length) {
+				//short read; the rest goes back in the queue:
+				piece.offset += uint32_t(cqe.res);
+				piece.length -= uint32_t(cqe.res);
+				pending.emplace_front(size_t(cqe.user_data));
+				continue;
+			}
+			if (cqe.res <= 0) file.failed = true; //(0: the file got shorter)
+			file.outstanding -= 1;
+			if (file.outstanding == 0) finished.emplace_back(piece.file);
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+		//hand over finished files (the other reads carry on meanwhile):
+		for (size_t i : finished) {
+			finish(i);
+		}
+	}
+	return true;
+}
+
+#else
+
+bool AssetReads::run_io_uring(bool *ok) {
+	return false;
+}
+
+#endif
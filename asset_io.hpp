@@ -0,0 +1,51 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * Batched whole-file reads, for loading a set of assets at once.
+ * On Linux, every read of a batch is submitted to one io_uring (into buffers registered with it up
+ * front, in ASSET_IO_CHUNK pieces, ASSET_IO_QUEUE_DEPTH of them in flight), so on high-latency storage
+ * (e.g. a network mount) the reads overlap instead of waiting on each other. Where io_uring isn't
+ * available -- other systems, old kernels, sandboxes that forbid it -- the files are read with pread()
+ * on a pool of up to ASSET_IO_THREADS threads instead.
+ * Each file's callback runs as soon as that file is in, while the rest are still being read.
+ */
+
+#define ASSET_IO_CHUNK (4 * 1024 * 1024)
+#define ASSET_IO_QUEUE_DEPTH 64
+#define ASSET_IO_THREADS 8
+
+struct AssetRead {
+	std::string filename;
+	std::vector< uint32_t > bytes; //the file's contents (as uint32_t, so they're 4-byte aligned), zero-padded
+	size_t size = 0; //in bytes
+	bool ok = false; //false if the file couldn't be opened or read
+};
+
+struct AssetReads {
+	//queue a read of 'filename'; 'on_read' (if given) is called from run() once it's done (or has failed),
+	//on run()'s thread with io_uring but on a pool thread otherwise, so callbacks must not share state unguarded:
+	AssetRead &add(std::string const &filename, std::function< void(AssetRead &) > const &on_read = nullptr);
+
+	//read everything added since the last run(); returns false (with messages on stderr) if any read failed:
+	bool run();
+
+	//set to false to always use the thread pool:
+	bool use_io_uring = true;
+	//what the last run() used ("io_uring" or "pread"):
+	char const *backend = "";
+
+	std::deque< AssetRead > reads; //(a deque, so add()'s references stay valid)
+
+private:
+	std::vector< std::function< void(AssetRead &) > > callbacks;
+	size_t first_new = 0; //reads before this were done by an earlier run()
+	bool run_io_uring(bool *ok); //false if io_uring isn't available
+	bool run_pread();
+};
@@ -0,0 +1,196 @@
+#include "asset_loader.hpp"
+#include "texture_format.hpp"
+#include "load_save_qoi.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+
+AssetLoader::AssetLoader(uint32_t thread_count) : pending(0) {
+	if (thread_count == 0) {
+		uint32_t cores = std::thread::hardware_concurrency();
+		thread_count = (cores > 1 ? cores - 1 : 1);
+	}
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		threads.emplace_back(&AssetLoader::worker, this);
+	}
+}
+
+AssetLoader::~AssetLoader() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+		todo.clear();
+	}
+	work_ready.notify_all();
+	posted_room.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+void AssetLoader::run(std::function< void() > const &work, std::function< bool() > const &upload) {
+	std::shared_ptr< Job > job = std::make_shared< Job >();
+	job->work = work;
+	job->upload = upload;
+	pending += 1;
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		todo.emplace_back(job);
+	}
+	work_ready.notify_one();
+}
+
+void AssetLoader::post(std::function< bool() > const &upload, uint32_t max_waiting) {
+	std::shared_ptr< Job > job = std::make_shared< Job >();
+	job->upload = upload;
+	job->posted = true;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		posted_room.wait(lock, [&](){ return quit || posted_waiting < max_waiting; });
+		if (quit) return;
+		posted_waiting += 1;
+		pending += 1;
+		done.emplace_back(job);
+	}
+	upload_ready.notify_one();
+}
+
+void AssetLoader::worker() {
+	while (true) {
+		std::shared_ptr< Job > job;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			work_ready.wait(lock, [this](){ return quit || !todo.empty(); });
+			if (quit) return;
+			job = todo.front();
+			todo.pop_front();
+		}
+		if (job->work) job->work();
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			done.emplace_back(job);
+		}
+		upload_ready.notify_one();
+	}
+}
+
+uint32_t AssetLoader::upload(float budget) {
+	if (!busy()) return 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	uint32_t completed = 0;
+	bool first = true;
+	while (true) {
+		if (!first && std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - start).count() >= budget) break;
+		first = false;
+
+		std::shared_ptr< Job > job;
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			if (done.empty()) break;
+			job = done.front();
+		}
+		//(only this thread pops 'done', so 'job' is still at the front afterward)
+		bool finished = (job->upload ? job->upload() : true);
+		if (finished) {
+			{
+				std::lock_guard< std::mutex > lock(mutex);
+				done.pop_front();
+				if (job->posted) posted_waiting -= 1;
+			}
+			if (job->posted) posted_room.notify_all();
+			pending -= 1;
+			completed += 1;
+		}
+	}
+	return completed;
+}
+
+void AssetLoader::finish(std::function< bool() > const &until) {
+	while (busy() && !(until && until())) {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			upload_ready.wait(lock, [this](){ return !done.empty(); });
+		}
+		upload(std::numeric_limits< float >::infinity());
+	}
+}
+
+void AssetLoader::load_texture(std::string const &filename, GLuint tex, OriginLocation origin, std::function< void(glm::uvec2) > const &on_loaded) {
+	struct Upload {
+		PngImage image;
+		bool loaded = false;
+		uint32_t rows_uploaded = 0;
+		bool allocated = false;
+		TextureFormat format;
+	};
+	std::shared_ptr< Upload > upload = std::make_shared< Upload >();
+
+	run([=](){
+		//kept in the PNG's own channels and bit depth (GL has no palette textures, so those are expanded):
+		upload->loaded = load_image(filename, &upload->image, origin, PngLoadExpandPalette);
+	}, [=]() -> bool {
+		PngImage const &image = upload->image;
+		if (!upload->loaded || image.width == 0 || image.height == 0) {
+			std::cerr << "Failed to load texture '" << filename << "'." << std::endl;
+			if (on_loaded) on_loaded(glm::uvec2(0,0));
+			return true;
+		}
+		glBindTexture(GL_TEXTURE_2D, tex);
+		if (!upload->allocated) {
+			upload->format = texture_allocate(image);
+			upload->allocated = true;
+		}
+		size_t row_size = image.row_size();
+		uint32_t rows = std::max(1u, uint32_t(TEXTURE_UPLOAD_SLICE / row_size));
+		rows = std::min(rows, image.height - upload->rows_uploaded);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, upload->format.unpack_alignment);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload->rows_uploaded, image.width, rows, upload->format.format, upload->format.type, &image.data[upload->rows_uploaded * row_size]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		upload->rows_uploaded += rows;
+		if (upload->rows_uploaded < image.height) return false;
+
+		//all uploaded; the decoded copy isn't needed any more:
+		glm::uvec2 size(image.width, image.height);
+		upload->image = PngImage();
+		if (on_loaded) on_loaded(size);
+		return true;
+	});
+}
+
+void AssetLoader::load_texture_pages(std::string const &filename, std::shared_ptr< TexturePages > const &pages, OriginLocation origin, std::function< void(glm::uvec2) > const &on_loaded) {
+	struct Stream {
+		glm::uvec2 size = glm::uvec2(0,0);
+		bool loaded = false;
+	};
+	std::shared_ptr< Stream > stream = std::make_shared< Stream >();
+
+	run([=](){
+		stream->loaded = load_image_rows(filename, [=](unsigned int width, unsigned int height) {
+			stream->size = glm::uvec2(width, height);
+			if (width == 0 || height == 0) return false;
+			post([=]() -> bool {
+				pages->allocate(glm::uvec2(width, height));
+				return true;
+			});
+			return true;
+		}, [=](unsigned int y, unsigned int count, uint32_t const *rows) {
+			//(the decoder reuses its band, so each one is copied to hand it to the GL thread)
+			std::shared_ptr< std::vector< uint32_t > > band = std::make_shared< std::vector< uint32_t > >(rows, rows + size_t(count) * stream->size.x);
+			post([=]() -> bool {
+				pages->upload(y, count, band->data());
+				return true;
+			});
+			return true;
+		}, origin);
+	}, [=]() -> bool {
+		if (!stream->loaded) {
+			std::cerr << "Failed to load texture '" << filename << "'." << std::endl;
+			if (on_loaded) on_loaded(glm::uvec2(0,0));
+			return true;
+		}
+		if (on_loaded) on_loaded(stream->size);
+		return true;
+	});
+}
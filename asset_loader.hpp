@@ -0,0 +1,88 @@
+#pragma once
+
+#include "GL.hpp"
+#include "load_save_png.hpp"
+#include "texture_pages.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Background asset loading.
+ * Each job has a 'work' part (decoding, parsing: anything that doesn't touch GL), run on a pool
+ * of worker threads, and an 'upload' part, run afterward on the GL thread from upload() or finish().
+ * upload() stops starting new steps once its time budget is spent, and an upload part can return
+ * false to be called again later, so a big texture can be spread across several frames.
+ */
+
+//texture uploads are split into slices of about this many bytes, so upload() can check its budget between them:
+#define TEXTURE_UPLOAD_SLICE (256 * 1024)
+
+struct AssetLoader {
+	//thread_count 0 means one worker per core, leaving one core for the GL thread:
+	AssetLoader(uint32_t thread_count = 0);
+	~AssetLoader();
+	AssetLoader(AssetLoader const &) = delete;
+	AssetLoader &operator=(AssetLoader const &) = delete;
+
+	//queue a job; 'upload' is called (on the GL thread) until it returns true:
+	void run(std::function< void() > const &work, std::function< bool() > const &upload);
+
+	//from inside a job's 'work': queue an extra upload step, to be done (on the GL thread, in the order
+	//posted) before the job's own 'upload' -- e.g. a band of an image still being decoded. Waits while
+	//'max_waiting' posted steps are already waiting, so a fast decoder can't run far ahead of the uploads:
+	void post(std::function< bool() > const &upload, uint32_t max_waiting = 4);
+
+	//decode a PNG (or QOI file, going by its magic) on a worker, then upload it into 'tex' (which should
+	//already exist) a slice at a time, in a GL format matching its channels and bit depth (see texture_format.hpp).
+	//'on_loaded' (if given) is called on the GL thread once it's all uploaded, with the image size,
+	//or with (0,0) if it failed to load:
+	void load_texture(std::string const &filename, GLuint tex, OriginLocation origin = LowerLeftOrigin,
+		std::function< void(glm::uvec2) > const &on_loaded = nullptr);
+
+	//the same for images that may be bigger than GL_MAX_TEXTURE_SIZE: the PNG or QOI is decoded in bands of rows,
+	//and each band is uploaded into 'pages' (see texture_pages.hpp) as it arrives, so the whole image is
+	//never in memory at once:
+	void load_texture_pages(std::string const &filename, std::shared_ptr< TexturePages > const &pages, OriginLocation origin = LowerLeftOrigin,
+		std::function< void(glm::uvec2) > const &on_loaded = nullptr);
+
+	//GL thread: do finished jobs' upload steps until 'budget' seconds have passed (always at least one
+	//step, if any are ready); returns the number of jobs that completed:
+	uint32_t upload(float budget);
+
+	//GL thread: wait for and upload everything, including jobs queued by other jobs' uploads;
+	//or, given 'until', stop as soon as it returns true:
+	void finish(std::function< bool() > const &until = nullptr);
+
+	//true while any job is queued, working, or waiting to upload:
+	bool busy() const { return pending.load() != 0; }
+
+private:
+	struct Job {
+		std::function< void() > work;
+		std::function< bool() > upload;
+		bool posted = false; //queued by post()
+	};
+	void worker();
+
+	std::vector< std::thread > threads;
+	std::mutex mutex;
+	std::condition_variable work_ready; //workers wait on this for 'todo'
+	std::condition_variable upload_ready; //finish() waits on this for 'done'
+	std::condition_variable posted_room; //post() waits on this for 'posted_waiting' to drop
+	uint32_t posted_waiting = 0; //posted steps in 'done'
+	std::deque< std::shared_ptr< Job > > todo; //waiting for a worker
+	std::deque< std::shared_ptr< Job > > done; //waiting for the GL thread
+	bool quit = false;
+	std::atomic< uint32_t > pending;
+};
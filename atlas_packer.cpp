@@ -0,0 +1,79 @@
+#include "atlas_packer.hpp"
+
+#include <algorithm>
+#include <limits>
+
+MaxRectsPacker::MaxRectsPacker(glm::uvec2 const &size_, bool allow_rotation_) : size(size_), allow_rotation(allow_rotation_) {
+	free_rects.emplace_back(glm::uvec2(0,0), size);
+}
+
+bool MaxRectsPacker::insert(glm::uvec2 const &want, glm::uvec2 *at, bool *rotated) {
+	//best short side fit, ties broken by long side:
+	unsigned int best_short = std::numeric_limits< unsigned int >::max();
+	unsigned int best_long = std::numeric_limits< unsigned int >::max();
+	bool found = false;
+	glm::uvec2 best_at = glm::uvec2(0,0);
+	bool best_rotated = false;
+
+	auto consider = [&](Rect const &free, glm::uvec2 const &dim, bool is_rotated) {
+		glm::uvec2 space = free.max - free.min;
+		if (dim.x > space.x || dim.y > space.y) return;
+		unsigned int left_x = space.x - dim.x;
+		unsigned int left_y = space.y - dim.y;
+		unsigned int short_side = std::min(left_x, left_y);
+		unsigned int long_side = std::max(left_x, left_y);
+		if (short_side < best_short || (short_side == best_short && long_side < best_long)) {
+			best_short = short_side;
+			best_long = long_side;
+			best_at = free.min;
+			best_rotated = is_rotated;
+			found = true;
+		}
+	};
+	for (auto const &free : free_rects) {
+		consider(free, want, false);
+		if (allow_rotation && want.x != want.y) {
+			consider(free, glm::uvec2(want.y, want.x), true);
+		}
+	}
+	if (!found) return false;
+
+	glm::uvec2 dim = best_rotated ? glm::uvec2(want.y, want.x) : want;
+	place(Rect(best_at, best_at + dim));
+	used = glm::max(used, best_at + dim);
+	*at = best_at;
+	*rotated = best_rotated;
+	return true;
+}
+
+void MaxRectsPacker::place(Rect const &placed) {
+	//split every free rectangle that overlaps 'placed' into up to four maximal pieces:
+	std::vector< Rect > next;
+	next.reserve(free_rects.size() + 4);
+	for (auto const &free : free_rects) {
+		if (placed.min.x >= free.max.x || placed.max.x <= free.min.x
+		 || placed.min.y >= free.max.y || placed.max.y <= free.min.y) {
+			next.emplace_back(free);
+			continue;
+		}
+		if (placed.min.x > free.min.x) next.emplace_back(free.min, glm::uvec2(placed.min.x, free.max.y));
+		if (placed.max.x < free.max.x) next.emplace_back(glm::uvec2(placed.max.x, free.min.y), free.max);
+		if (placed.min.y > free.min.y) next.emplace_back(free.min, glm::uvec2(free.max.x, placed.min.y));
+		if (placed.max.y < free.max.y) next.emplace_back(glm::uvec2(free.min.x, placed.max.y), free.max);
+	}
+
+	//drop free rectangles contained in others:
+	auto contains = [](Rect const &a, Rect const &b) {
+		return a.min.x <= b.min.x && a.min.y <= b.min.y && a.max.x >= b.max.x && a.max.y >= b.max.y;
+	};
+	free_rects.clear();
+	for (uint32_t i = 0; i < next.size(); ++i) {
+		bool redundant = false;
+		for (uint32_t j = 0; j < next.size() && !redundant; ++j) {
+			if (i == j || !contains(next[j], next[i])) continue;
+			//of two identical rectangles, keep the first:
+			redundant = !contains(next[i], next[j]) || j < i;
+		}
+		if (!redundant) free_rects.emplace_back(next[i]);
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/*
+ * MaxRects rectangle packer ("best short side fit", after Jukka Jylänki's survey).
+ * Keeps a list of maximal free rectangles; each insert picks the free rectangle
+ * (and orientation, if rotation is allowed) that leaves the smallest leftover side,
+ * then splits every free rectangle the new one overlaps and prunes contained ones.
+ */
+
+struct MaxRectsPacker {
+	MaxRectsPacker(glm::uvec2 const &size, bool allow_rotation);
+
+	//place a 'size' rectangle; returns false if it doesn't fit.
+	//'rotated' means the rectangle was placed as size.y x size.x:
+	bool insert(glm::uvec2 const &size, glm::uvec2 *at, bool *rotated);
+
+	//extent of everything placed so far:
+	glm::uvec2 used = glm::uvec2(0,0);
+
+	glm::uvec2 size;
+	bool allow_rotation;
+
+private:
+	struct Rect {
+		Rect(glm::uvec2 const &min_, glm::uvec2 const &max_) : min(min_), max(max_) { }
+		glm::uvec2 min, max; //max is exclusive
+	};
+	std::vector< Rect > free_rects;
+	void place(Rect const &rect);
+};
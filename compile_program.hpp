@@ -0,0 +1,12 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <string>
+
+/*
+ * Shader compile/link helpers; both throw std::runtime_error (after logging the info log) on failure.
+ */
+
+GLuint compile_shader(GLenum type, std::string const &source);
+GLuint link_program(GLuint fragment_shader, GLuint vertex_shader);
@@ -0,0 +1,59 @@
+//cook_bundle: pre-decode an atlas PNG (or QOI) and pack it, with its sprite table, into an asset bundle (see asset_bundle.hpp).
+//usage: cook_bundle atlas.png sprites.atlas out.bundle
+
+#include "asset_bundle.hpp"
+#include "asset_cache.hpp"
+#include "load_save_qoi.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc != 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " atlas.png sprites.atlas out.bundle" << std::endl;
+		return 1;
+	}
+	std::string in_png = argv[1];
+	std::string in_atlas = argv[2];
+	std::string out_bundle = argv[3];
+
+	glm::uvec2 size = glm::uvec2(0,0);
+	std::vector< uint32_t > texels;
+	if (!load_image(in_png, &size.x, &size.y, &texels, LowerLeftOrigin)) {
+		std::cerr << "Failed to load '" << in_png << "'." << std::endl;
+		return 1;
+	}
+
+	//validate the sprite table (and that it goes with this texture) before copying it in verbatim:
+	MappedFile atlas_file;
+	if (!atlas_file.open(in_atlas)) return 1;
+	{
+		SpriteAtlas atlas;
+		if (!atlas.load(atlas_file.data, atlas_file.size, in_atlas)) return 1;
+		if (atlas.header->width != size.x || atlas.header->height != size.y) {
+			std::cerr << "'" << in_atlas << "' is for a " << atlas.header->width << "x" << atlas.header->height
+				<< " texture, but '" << in_png << "' is " << size.x << "x" << size.y << "." << std::endl;
+			return 1;
+		}
+	}
+
+	//(recording what it was cooked from, so the game can use it as a cache entry; see asset_cache.hpp)
+	uint64_t source_hash = 0;
+	if (!asset_source_hash({in_png, in_atlas}, &source_hash)) return 1;
+	std::vector< uint32_t > bundle;
+	make_bundle(size.x, size.y, texels.data(), atlas_file.data, atlas_file.size, source_hash, &bundle);
+
+	std::ofstream out(out_bundle, std::ios::binary);
+	out.write(reinterpret_cast< char const * >(bundle.data()), bundle.size() * 4);
+	if (!out) {
+		std::cerr << "Failed to write '" << out_bundle << "'." << std::endl;
+		return 1;
+	}
+
+	std::cout << "Cooked " << size.x << "x" << size.y << " texels and " << atlas_file.size << " bytes of sprite table into '" << out_bundle << "'." << std::endl;
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include "file_watcher.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+FileWatcher::FileWatcher() {
+	#ifdef __linux__
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		std::cerr << "NOTE: inotify unavailable (" << strerror(errno) << "); polling watched files instead." << std::endl;
+	}
+	#endif
+	next_poll = std::chrono::steady_clock::now();
+}
+
+FileWatcher::~FileWatcher() {
+	#ifdef __linux__
+	if (fd >= 0) ::close(fd);
+	#endif
+}
+
+bool FileWatcher::watch(std::string const &filename) {
+	Watched watched;
+	watched.filename = filename;
+	size_t slash = filename.find_last_of("/\\");
+	std::string dir = (slash == std::string::npos ? "." : filename.substr(0, slash));
+	watched.base = (slash == std::string::npos ? filename : filename.substr(slash + 1));
+
+	#ifdef __linux__
+	if (fd >= 0) {
+		//close-write catches in-place saves; moved-to catches save-to-temporary-then-rename:
+		watched.dir = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watched.dir < 0) {
+			std::cerr << "Failed to watch '" << dir << "' (" << strerror(errno) << ")." << std::endl;
+			return false;
+		}
+		files.emplace_back(watched);
+		return true;
+	}
+	#endif
+
+	struct stat info;
+	if (stat(filename.c_str(), &info) == 0) {
+		watched.mtime = int64_t(info.st_mtime);
+		watched.size = int64_t(info.st_size);
+	}
+	files.emplace_back(watched);
+	return true;
+}
+
+std::vector< std::string > FileWatcher::changed() {
+	std::vector< std::string > ret;
+	auto note = [&ret](std::string const &filename) {
+		if (std::find(ret.begin(), ret.end(), filename) == ret.end()) ret.emplace_back(filename);
+	};
+
+	#ifdef __linux__
+	if (fd >= 0) {
+		alignas(struct inotify_event) char buffer[4096];
+		while (true) {
+			ssize_t got = read(fd, buffer, sizeof(buffer));
+			if (got <= 0) break; //(EAGAIN: nothing more for now)
+			for (char *at = buffer; at < buffer + got; ) {
+				struct inotify_event const *event = reinterpret_cast< struct inotify_event const * >(at);
+				if (event->len > 0) {
+					for (auto const &watched : files) {
+						if (watched.dir == event->wd && watched.base == event->name) note(watched.filename);
+					}
+				}
+				at += sizeof(struct inotify_event) + event->len;
+			}
+		}
+		return ret;
+	}
+	#endif
+
+	auto now = std::chrono::steady_clock::now();
+	if (now < next_poll) return ret;
+	next_poll = now + std::chrono::milliseconds(FILE_WATCHER_POLL_MS);
+	for (auto &watched : files) {
+		struct stat info;
+		if (stat(watched.filename.c_str(), &info) != 0) continue;
+		if (int64_t(info.st_mtime) != watched.mtime || int64_t(info.st_size) != watched.size) {
+			watched.mtime = int64_t(info.st_mtime);
+			watched.size = int64_t(info.st_size);
+			note(watched.filename);
+		}
+	}
+	return ret;
+}
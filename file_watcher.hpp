@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Notices when files are rewritten, for reloading assets while the game runs.
+ * On Linux this is inotify on the files' directories (so files replaced by a rename, as many
+ * editors save, are still seen, and a file may be watched before it exists); elsewhere it
+ * compares modification times and sizes, at most every FILE_WATCHER_POLL_MS.
+ */
+
+#define FILE_WATCHER_POLL_MS 250
+
+struct FileWatcher {
+	FileWatcher();
+	~FileWatcher();
+	FileWatcher(FileWatcher const &) = delete;
+	FileWatcher &operator=(FileWatcher const &) = delete;
+
+	//start watching 'filename'; returns false (with a message on stderr) if that isn't possible:
+	bool watch(std::string const &filename);
+
+	//names (as given to watch()) of files finished writing since the last call; never blocks:
+	std::vector< std::string > changed();
+
+private:
+	struct Watched {
+		std::string filename;
+		int dir = -1; //inotify watch descriptor of the containing directory
+		std::string base; //name within that directory
+		int64_t mtime = 0; //(stat fallback)
+		int64_t size = -1;
+	};
+	std::vector< Watched > files;
+	int fd = -1; //inotify instance
+	std::chrono::steady_clock::time_point next_poll;
+};
@@ -0,0 +1,103 @@
+#include "frame_capture.hpp"
+
+#include <iostream>
+#include <cstring>
+
+FrameCapture::FrameCapture(uint32_t ring_size) : slots(ring_size < 1 ? 1 : ring_size) {
+	options.compression_level = 1;
+	options.strategy = PngStrategyRLE;
+	options.filters = PngFilterUp;
+	options.threads = 1; //(the writer runs alongside the game; it shouldn't take every core)
+	for (auto &slot : slots) {
+		glGenBuffers(1, &slot.buffer);
+	}
+}
+
+FrameCapture::~FrameCapture() {
+	for (auto &slot : slots) {
+		if (slot.fence) glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+	}
+}
+
+void FrameCapture::capture(glm::uvec2 const &size, std::string const &filename) {
+	Slot &slot = slots[next];
+	if (slot.fence) {
+		//the ring has wrapped around onto a readback that isn't done yet:
+		stalls += 1;
+		retire(slot, true);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	size_t bytes = size_t(size.x) * size_t(size.y) * 4;
+	if (slot.buffer_size != bytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		slot.buffer_size = bytes;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	//with a pack buffer bound, the last argument is an offset into it, and the call returns without waiting:
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.size = size;
+	slot.filename = filename;
+
+	next = (next + 1) % slots.size();
+}
+
+void FrameCapture::poll() {
+	for (uint32_t i = 0; i < slots.size(); ++i) {
+		Slot &slot = slots[(next + i) % slots.size()];
+		if (!slot.fence) continue;
+		//stop at the first readback still in flight, so files are handed off in capture order:
+		if (!retire(slot, false)) break;
+	}
+}
+
+void FrameCapture::finish() {
+	for (uint32_t i = 0; i < slots.size(); ++i) {
+		Slot &slot = slots[(next + i) % slots.size()];
+		if (slot.fence) retire(slot, true);
+	}
+}
+
+bool FrameCapture::retire(Slot &slot, bool wait) {
+	GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+	if (status == GL_TIMEOUT_EXPIRED) return false;
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	if (status == GL_WAIT_FAILED) {
+		std::cerr << "Failed to wait for capture of '" << slot.filename << "'; dropping it." << std::endl;
+		return true;
+	}
+
+	std::vector< uint32_t > data(size_t(slot.size.x) * size_t(slot.size.y));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	void const *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, data.size() * 4, GL_MAP_READ_BIT);
+	if (mapped) {
+		memcpy(data.data(), mapped, data.size() * 4);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (!mapped) {
+		std::cerr << "Failed to map capture of '" << slot.filename << "'; dropping it." << std::endl;
+		return true;
+	}
+
+	//forget saves that are done; if the writer is still 'max_pending' behind, wait for the oldest:
+	while (!pending.empty() && pending.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		pending.pop_front();
+	}
+	if (pending.size() >= max_pending) {
+		writer_stalls += 1;
+		while (!pending.empty() && pending.size() >= max_pending) {
+			pending.front().wait();
+			pending.pop_front();
+		}
+	}
+
+	//(glReadPixels rows start at the bottom of the framebuffer)
+	pending.emplace_back(save_png_async(slot.filename, slot.size.x, slot.size.y, std::move(data), LowerLeftOrigin, options));
+	captured += 1;
+	return true;
+}
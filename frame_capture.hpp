@@ -0,0 +1,62 @@
+#pragma once
+
+#include "GL.hpp"
+#include "load_save_png.hpp"
+
+#include <glm/glm.hpp>
+
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Framebuffer capture without pipeline stalls.
+ * capture() only queues a glReadPixels into one of a ring of pixel pack buffers and drops a fence
+ * after it; poll() (once per frame) maps the buffers whose fences have signaled -- normally a frame
+ * or two later -- and hands the pixels to save_png_async, so neither readback nor encoding blocks
+ * the frame loop. A capture only waits if the ring wraps around onto a readback still in flight,
+ * or if the writer falls 'max_pending' saves behind (so memory stays bounded while capturing).
+ */
+
+struct FrameCapture {
+	FrameCapture(uint32_t ring_size = 3);
+	~FrameCapture();
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	//read the lower-left 'size' pixels of the current read framebuffer (call after drawing, before swapping)
+	//and save them to 'filename' once the GPU gets to it:
+	void capture(glm::uvec2 const &size, std::string const &filename);
+
+	//hand finished readbacks, oldest first, to the PNG writer; call once per frame:
+	void poll();
+
+	//wait for every readback still in flight and hand it off (save_png_flush() then waits for the files):
+	void finish();
+
+	//encoder settings; the defaults favor speed, so encoding keeps up with continuous capture:
+	PngSaveOptions options;
+	//most captured frames waiting to be written (each holds a full frame of pixels):
+	uint32_t max_pending = 8;
+
+	uint32_t captured = 0; //handed off to the PNG writer
+	uint32_t stalls = 0; //captures that had to wait for an old readback to free its ring slot
+	uint32_t writer_stalls = 0; //hand-offs that had to wait for the writer to catch up
+
+private:
+	struct Slot {
+		GLuint buffer = 0;
+		size_t buffer_size = 0;
+		GLsync fence = 0; //non-zero while a readback is in flight
+		glm::uvec2 size = glm::uvec2(0,0);
+		std::string filename;
+	};
+	std::vector< Slot > slots;
+	uint32_t next = 0; //slot the next capture uses (which is also the oldest in flight)
+	std::deque< std::future< bool > > pending; //saves handed off, oldest first (they finish in order)
+
+	//map and hand off 'slot' if its readback is done (or, with 'wait', once it is); false if still in flight:
+	bool retire(Slot &slot, bool wait);
+};
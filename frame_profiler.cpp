@@ -0,0 +1,130 @@
+#include "frame_profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+//phases that issue GL work worth timing on the GPU:
+static bool gpu_timed(FrameProfiler::Phase phase) {
+	return phase == FrameProfiler::PhaseUpload || phase == FrameProfiler::PhaseDraw;
+}
+
+char const *FrameProfiler::phase_name(Phase phase) {
+	switch (phase) {
+		case PhaseEvents: return "EV";
+		case PhaseUpdate: return "UP";
+		case PhaseBuild: return "BU";
+		case PhaseUpload: return "UL";
+		case PhaseDraw: return "DR";
+		case PhaseSwap: return "SW";
+		default: return "";
+	}
+}
+
+FrameProfiler::FrameProfiler() {
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		cpu_history[p].assign(Window, 0.0f);
+		gpu_history[p].assign(Window, 0.0f);
+		phase_cpu[p] = 0.0f;
+	}
+	frame_history.assign(Window, 0.0f);
+	queries.assign(QueryFrames * PhaseCount, 0);
+	query_issued.assign(QueryFrames * PhaseCount, false);
+	glGenQueries(queries.size(), queries.data());
+	for (uint32_t s = 0; s < QueryFrames; ++s) {
+		slot_frame[s] = 0;
+	}
+}
+
+FrameProfiler::~FrameProfiler() {
+	glDeleteQueries(queries.size(), queries.data());
+}
+
+void FrameProfiler::collect_queries(uint32_t slot) {
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		uint32_t q = slot * PhaseCount + p;
+		if (!query_issued[q]) continue;
+		query_issued[q] = false;
+		//results older than the history window have nowhere to go:
+		if (frame - slot_frame[slot] >= Window) continue;
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue; //never wait; just lose this sample
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &ns);
+		//some software rasterizers (llvmpipe) report timestamps instead of durations for work that wasn't flushed:
+		if (ns > 1000000000ull) continue;
+		gpu_history[p][slot_frame[slot] % Window] = float(ns) * 1.0e-6f;
+	}
+}
+
+void FrameProfiler::begin_frame() {
+	Clock::time_point now = Clock::now();
+	if (started) {
+		frame_history[frame % Window] = std::chrono::duration< float, std::milli >(now - frame_start).count();
+	}
+	frame_start = now;
+	started = true;
+
+	//this frame's queries reuse the oldest ring slot:
+	uint32_t slot = frame % QueryFrames;
+	collect_queries(slot);
+	slot_frame[slot] = frame;
+}
+
+void FrameProfiler::end_frame() {
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		cpu_history[p][frame % Window] = phase_cpu[p];
+		phase_cpu[p] = 0.0f;
+	}
+	frame += 1;
+	frames_recorded = std::min(frames_recorded + 1, Window);
+
+	update_timings();
+}
+
+void FrameProfiler::begin(Phase phase) {
+	assert(phase < PhaseCount);
+	phase_start[phase] = Clock::now();
+	if (gpu_timed(phase)) {
+		//GL_TIME_ELAPSED queries can't nest:
+		assert(!query_active);
+		uint32_t q = (frame % QueryFrames) * PhaseCount + phase;
+		glBeginQuery(GL_TIME_ELAPSED, queries[q]);
+		query_issued[q] = true;
+		query_active = true;
+	}
+}
+
+void FrameProfiler::end(Phase phase) {
+	assert(phase < PhaseCount);
+	if (gpu_timed(phase)) {
+		glEndQuery(GL_TIME_ELAPSED);
+		query_active = false;
+	}
+	phase_cpu[phase] += std::chrono::duration< float, std::milli >(Clock::now() - phase_start[phase]).count();
+}
+
+void FrameProfiler::update_timings() {
+	if (frames_recorded == 0) return;
+	//entries past 'frames_recorded' are still zero, so sums and maxima over the whole window are fine:
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		Timing &t = phase_timing[p];
+		t.cpu_avg = 0.0f;
+		t.cpu_worst = 0.0f;
+		t.gpu_avg = 0.0f;
+		for (uint32_t i = 0; i < Window; ++i) {
+			t.cpu_avg += cpu_history[p][i];
+			t.cpu_worst = std::max(t.cpu_worst, cpu_history[p][i]);
+			t.gpu_avg += gpu_history[p][i];
+		}
+		t.cpu_avg /= frames_recorded;
+		t.gpu_avg /= frames_recorded;
+	}
+	frame_avg = 0.0f;
+	frame_worst = 0.0f;
+	for (uint32_t i = 0; i < Window; ++i) {
+		frame_avg += frame_history[i];
+		frame_worst = std::max(frame_worst, frame_history[i]);
+	}
+	frame_avg /= frames_recorded;
+}
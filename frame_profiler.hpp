@@ -0,0 +1,86 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <chrono>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Per-frame phase timing.
+ * CPU time is measured with scoped timers; GPU time for phases that issue GL work is measured
+ * with GL_TIME_ELAPSED queries. Queries live in a ring several frames deep and are only read
+ * once their results are available, so profiling never stalls the pipeline (a result that is
+ * still pending when its ring slot comes around again is dropped).
+ * Averages and worst cases are taken over the last 'Window' profiled frames.
+ */
+
+struct FrameProfiler {
+	enum Phase {
+		PhaseEvents = 0, //event pump
+		PhaseUpdate,     //state update
+		PhaseBuild,      //game logic + queueing sprites
+		PhaseUpload,     //sorting + writing vertex records
+		PhaseDraw,       //clear + draw calls
+		PhaseSwap,       //SDL_GL_SwapWindow (or glFinish when headless)
+		PhaseCount
+	};
+	static char const *phase_name(Phase phase);
+
+	FrameProfiler();
+	~FrameProfiler();
+	FrameProfiler(FrameProfiler const &) = delete;
+	FrameProfiler &operator=(FrameProfiler const &) = delete;
+
+	//frames are bracketed by begin_frame()/end_frame(), phases by begin()/end() (or a Scope).
+	//Phase time accumulates until end_frame(), so phases may also run before begin_frame():
+	void begin_frame();
+	void end_frame();
+	void begin(Phase phase);
+	void end(Phase phase);
+
+	struct Scope {
+		Scope(FrameProfiler &profiler_, Phase phase_) : profiler(profiler_), phase(phase_) { profiler.begin(phase); }
+		~Scope() { profiler.end(phase); }
+		FrameProfiler &profiler;
+		Phase phase;
+	};
+
+	//rolling results, in milliseconds:
+	struct Timing {
+		float cpu_avg = 0.0f;
+		float cpu_worst = 0.0f;
+		float gpu_avg = 0.0f; //stays zero for phases without GL work
+	};
+	Timing phase_timing[PhaseCount];
+	float frame_avg = 0.0f; //begin_frame() to begin_frame()
+	float frame_worst = 0.0f;
+
+	static constexpr uint32_t Window = 60;
+	//frames of GPU queries in flight before a slot is reused:
+	static constexpr uint32_t QueryFrames = 4;
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+	void collect_queries(uint32_t slot);
+	void update_timings();
+
+	//history, indexed [frame % Window]:
+	std::vector< float > cpu_history[PhaseCount];
+	std::vector< float > gpu_history[PhaseCount];
+	std::vector< float > frame_history;
+	uint32_t frame = 0;
+	uint32_t frames_recorded = 0;
+	Clock::time_point frame_start;
+	bool started = false;
+
+	Clock::time_point phase_start[PhaseCount];
+	float phase_cpu[PhaseCount];
+
+	//query ring, indexed [slot * PhaseCount + phase]:
+	std::vector< GLuint > queries;
+	std::vector< bool > query_issued;
+	//frame whose GPU times each ring slot holds:
+	uint32_t slot_frame[QueryFrames];
+	bool query_active = false;
+};
@@ -0,0 +1,131 @@
+#include "headless_context.hpp"
+
+#include <stdexcept>
+#include <cstring>
+
+#ifdef HEADLESS_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static bool has_extension(char const *list, char const *name) {
+	if (!list) return false;
+	size_t len = strlen(name);
+	for (char const *at = strstr(list, name); at; at = strstr(at + len, name)) {
+		if ((at == list || at[-1] == ' ') && (at[len] == ' ' || at[len] == '\0')) return true;
+	}
+	return false;
+}
+
+HeadlessContext::HeadlessContext(glm::uvec2 const &size_) : size(size_) {
+	//prefer Mesa's surfaceless platform, which needs no X server or GPU device:
+	EGLDisplay egl_display = EGL_NO_DISPLAY;
+	char const *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+		auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display) egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (egl_display == EGL_NO_DISPLAY) egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (egl_display == EGL_NO_DISPLAY) throw std::runtime_error("Failed to get an EGL display.");
+
+	EGLint major = 0, minor = 0;
+	if (!eglInitialize(egl_display, &major, &minor)) throw std::runtime_error("Failed to initialize EGL.");
+	display = egl_display;
+
+	if (!eglBindAPI(EGL_OPENGL_API)) throw std::runtime_error("EGL does not support desktop OpenGL.");
+
+	EGLint const config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+		throw std::runtime_error("No EGL config supports offscreen desktop OpenGL.");
+	}
+
+	//same version and profile the windowed path asks SDL for:
+	EGLint const context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+	if (egl_context == EGL_NO_CONTEXT) throw std::runtime_error("Failed to create an OpenGL 3.3 core context through EGL.");
+	context = egl_context;
+
+	//nothing is ever drawn to the default framebuffer, so only create a surface if EGL insists on one:
+	EGLSurface egl_surface = EGL_NO_SURFACE;
+	if (!has_extension(eglQueryString(egl_display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		EGLint const pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		egl_surface = eglCreatePbufferSurface(egl_display, config, pbuffer_attribs);
+		if (egl_surface == EGL_NO_SURFACE) throw std::runtime_error("Failed to create an EGL pbuffer.");
+		surface = egl_surface;
+	}
+	if (!eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
+		throw std::runtime_error("Failed to make the EGL context current.");
+	}
+
+	{ //create the framebuffer that stands in for a window:
+		glGenRenderbuffers(1, &color_renderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			throw std::runtime_error("Headless framebuffer is incomplete.");
+		}
+		glViewport(0, 0, size.x, size.y);
+	}
+}
+
+HeadlessContext::~HeadlessContext() {
+	if (context) {
+		glDeleteFramebuffers(1, &framebuffer);
+		framebuffer = 0;
+		glDeleteRenderbuffers(1, &color_renderbuffer);
+		color_renderbuffer = 0;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+		context = nullptr;
+	}
+	if (surface) {
+		eglDestroySurface(display, surface);
+		surface = nullptr;
+	}
+	if (display) {
+		eglTerminate(display);
+		display = nullptr;
+	}
+}
+
+void HeadlessContext::read_pixels(std::vector< uint32_t > *data) const {
+	data->resize(size.x * size.y);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, data->data());
+}
+
+#else //!HEADLESS_EGL
+
+HeadlessContext::HeadlessContext(glm::uvec2 const &size_) : size(size_) {
+	throw std::runtime_error("Headless rendering needs EGL; this build was made without HEADLESS_EGL.");
+}
+
+HeadlessContext::~HeadlessContext() {
+}
+
+void HeadlessContext::read_pixels(std::vector< uint32_t > *data) const {
+	data->clear();
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Windowless OpenGL 3.3 core context for running the draw path without a display.
+ * Uses EGL (surfaceless if EGL_KHR_surfaceless_context is available, otherwise a 1x1 pbuffer),
+ * so Mesa's llvmpipe works on machines with no GPU. All drawing goes to 'framebuffer',
+ * which is left bound to GL_FRAMEBUFFER and has an RGBA8 color buffer of 'size'.
+ * Only available in builds with HEADLESS_EGL defined; otherwise the constructor throws.
+ */
+
+struct HeadlessContext {
+	HeadlessContext(glm::uvec2 const &size);
+	~HeadlessContext();
+	HeadlessContext(HeadlessContext const &) = delete;
+	HeadlessContext &operator=(HeadlessContext const &) = delete;
+
+	//copy the framebuffer's contents (lower-left origin, as for save_png):
+	void read_pixels(std::vector< uint32_t > *data) const;
+
+	glm::uvec2 size = glm::uvec2(0,0);
+	GLuint framebuffer = 0;
+
+private:
+	GLuint color_renderbuffer = 0;
+	//EGL handles, kept opaque so users don't need EGL headers:
+	void *display = nullptr;
+	void *context = nullptr;
+	void *surface = nullptr;
+};
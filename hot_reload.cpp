@@ -0,0 +1,246 @@
+#include "hot_reload.hpp"
+#include "load_save_qoi.hpp"
+#include "sprite_atlas.hpp"
+#include "texture_format.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+
+HotReload::HotReload(AssetLoader &loader_, GLuint tex_, SpriteRegistry &sprites_) : loader(loader_), tex(tex_), sprites(sprites_), resident(std::make_shared< PngImage >()) {
+}
+
+bool HotReload::watch_texture(std::string const &filename) {
+	if (!watcher.watch(filename)) return false;
+	texture_files.emplace_back(filename);
+	return true;
+}
+
+bool HotReload::watch_sprites(std::string const &filename) {
+	if (!watcher.watch(filename)) return false;
+	sprite_files.emplace_back(filename);
+	return true;
+}
+
+void HotReload::poll() {
+	for (auto const &filename : watcher.changed()) {
+		if (std::find(texture_files.begin(), texture_files.end(), filename) != texture_files.end()) {
+			if (texture_busy == "") reload_texture(filename);
+			else texture_next = filename;
+		}
+		if (std::find(sprite_files.begin(), sprite_files.end(), filename) != sprite_files.end()) {
+			if (sprites_busy == "") reload_sprites(filename);
+			else sprites_next = filename;
+		}
+	}
+}
+
+//rectangles (x, y, width, height) covering every HOT_RELOAD_TILE-square tile in which same-sized images
+//'a' and 'b' differ; runs of changed tiles in a row of tiles become one rectangle, which grows downward
+//while the same run of tiles keeps changing in the rows below:
+static std::vector< glm::uvec4 > changed_rects(PngImage const &a, PngImage const &b) {
+	std::vector< glm::uvec4 > rects;
+	size_t pixel_size = a.row_size() / std::max(1u, a.width);
+	uint32_t columns = (a.width + HOT_RELOAD_TILE - 1) / HOT_RELOAD_TILE;
+	std::vector< bool > changed(columns);
+	std::vector< size_t > open, next_open; //rectangles that reach the current tile row
+	for (uint32_t y = 0; y < a.height; y += HOT_RELOAD_TILE) {
+		uint32_t height = std::min< uint32_t >(HOT_RELOAD_TILE, a.height - y);
+		std::fill(changed.begin(), changed.end(), false);
+		for (uint32_t row = y; row < y + height; ++row) {
+			uint8_t const *ra = &a.data[row * a.row_size()];
+			uint8_t const *rb = &b.data[row * b.row_size()];
+			if (memcmp(ra, rb, a.row_size()) == 0) continue;
+			for (uint32_t c = 0; c < columns; ++c) {
+				if (changed[c]) continue;
+				size_t x = c * HOT_RELOAD_TILE;
+				changed[c] = (memcmp(ra + x * pixel_size, rb + x * pixel_size, std::min< size_t >(HOT_RELOAD_TILE, a.width - x) * pixel_size) != 0);
+			}
+		}
+
+		next_open.clear();
+		for (uint32_t c = 0; c < columns; ) {
+			if (!changed[c]) {
+				++c;
+				continue;
+			}
+			uint32_t end = c;
+			while (end < columns && changed[end]) ++end;
+			glm::uvec4 rect(c * HOT_RELOAD_TILE, y, std::min(end * HOT_RELOAD_TILE, a.width) - c * HOT_RELOAD_TILE, height);
+			auto above = std::find_if(open.begin(), open.end(), [&](size_t i){
+				return rects[i].x == rect.x && rects[i].z == rect.z;
+			});
+			if (above != open.end()) {
+				rects[*above].w += height;
+				next_open.emplace_back(*above);
+			} else {
+				next_open.emplace_back(rects.size());
+				rects.emplace_back(rect);
+			}
+			c = end;
+		}
+		open.swap(next_open);
+	}
+	return rects;
+}
+
+void HotReload::reload_texture(std::string const &filename) {
+	texture_busy = filename;
+	texture_next = "";
+
+	std::shared_ptr< PngImage > current = resident;
+	if (current->data.empty()) {
+		//(the texture may have come from a bundle, so the only sure copy of it is in GL)
+		GLint width = 0, height = 0, internal_format = 0;
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+		//read it back in the layout texture_allocate() would have given it:
+		current->width = width;
+		current->height = height;
+		current->bit_depth = 8;
+		if (internal_format == GL_R8) current->channels = 1;
+		else if (internal_format == GL_RG8) current->channels = 2;
+		else if (internal_format == GL_RGB8) current->channels = 3;
+		else current->channels = 4;
+		current->data.resize(current->row_size() * current->height);
+		if (!current->data.empty()) {
+			TextureFormat format = texture_format(*current);
+			glPixelStorei(GL_PACK_ALIGNMENT, format.unpack_alignment);
+			glGetTexImage(GL_TEXTURE_2D, 0, format.format, format.type, current->data.data());
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		}
+	}
+
+	struct Update {
+		PngImage image;
+		bool loaded = false;
+		bool reallocate = false; //size or layout changed, so the whole texture is replaced
+		TextureFormat format;
+		std::vector< glm::uvec4 > rects;
+		size_t rect = 0; //next rectangle to upload
+		uint32_t row = 0; //...and next row of it
+		size_t texels = 0; //total in 'rects'
+	};
+	std::shared_ptr< Update > update = std::make_shared< Update >();
+
+	loader.run([filename,current,update](){
+		//(decoded the same way AssetLoader::load_texture does)
+		PngImage &image = update->image;
+		update->loaded = load_image(filename, &image, LowerLeftOrigin, PngLoadExpandPalette);
+		if (!update->loaded || image.width == 0 || image.height == 0) return;
+		update->format = texture_format(image);
+		if (image.width != current->width || image.height != current->height || image.channels != current->channels || image.bit_depth != current->bit_depth) {
+			update->reallocate = true;
+			update->rects.emplace_back(0, 0, image.width, image.height);
+		} else {
+			update->rects = changed_rects(*current, image);
+		}
+		for (auto const &rect : update->rects) {
+			update->texels += size_t(rect.z) * size_t(rect.w);
+		}
+	}, [this,filename,current,update]() -> bool {
+		PngImage &image = update->image;
+		if (!update->loaded || image.width == 0 || image.height == 0) {
+			std::cerr << "Failed to reload '" << filename << "'; keeping the old texture." << std::endl;
+		} else {
+			glBindTexture(GL_TEXTURE_2D, tex);
+			if (update->reallocate && update->rect == 0 && update->row == 0) {
+				texture_allocate(image);
+			}
+			//rectangles are read out of the full image, so rows are image.width pixels apart:
+			size_t pixel_size = image.row_size() / image.width;
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, image.width);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, update->format.unpack_alignment);
+			size_t sent = 0;
+			while (update->rect < update->rects.size() && sent < TEXTURE_UPLOAD_SLICE) {
+				glm::uvec4 const &rect = update->rects[update->rect];
+				uint32_t rows = std::max(1u, uint32_t((TEXTURE_UPLOAD_SLICE - sent) / (rect.z * pixel_size)));
+				rows = std::min(rows, rect.w - update->row);
+				uint32_t y = rect.y + update->row;
+				glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, y, rect.z, rows, update->format.format, update->format.type, &image.data[y * image.row_size() + rect.x * pixel_size]);
+				sent += size_t(rect.z) * rows * pixel_size;
+				update->row += rows;
+				if (update->row == rect.w) {
+					update->rect += 1;
+					update->row = 0;
+				}
+			}
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			if (update->rect < update->rects.size()) return false;
+
+			size_t total = size_t(image.width) * size_t(image.height);
+			std::cout << "Reloaded '" << filename << "': " << update->rects.size() << " rectangles, "
+				<< update->texels << " of " << total << " texels uploaded." << std::endl;
+			if (update->reallocate && (image.width != current->width || image.height != current->height)) {
+				std::cout << "NOTE: '" << filename << "' changed size; sprite coordinates are relative, so the sprite table may need updating too." << std::endl;
+			}
+			*current = std::move(image);
+			if (on_texture_reloaded) on_texture_reloaded();
+		}
+
+		texture_busy = "";
+		if (texture_next != "") reload_texture(texture_next);
+		return true;
+	});
+}
+
+void HotReload::reload_sprites(std::string const &filename) {
+	sprites_busy = filename;
+	sprites_next = "";
+
+	//the old spriteBin.bin format gives pixel coordinates, so converting it needs the texture's size:
+	glm::uvec2 size = glm::uvec2(resident->width, resident->height);
+	if (resident->data.empty()) {
+		GLint width = 0, height = 0;
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		size = glm::uvec2(width, height);
+	}
+
+	struct Update {
+		SpriteRegistry sprites;
+		bool loaded = false;
+	};
+	std::shared_ptr< Update > update = std::make_shared< Update >();
+
+	loader.run([filename,size,update](){
+		SpriteAtlas atlas;
+		bool is_atlas = (filename.size() >= 6 && filename.substr(filename.size() - 6) == ".atlas");
+		if (is_atlas ? !atlas.load(filename) : !atlas.load_sprite_bin(filename, size.x, size.y)) return;
+		try {
+			atlas.register_sprites(update->sprites);
+		} catch (std::exception &e) {
+			std::cerr << "Sprite table '" << filename << "': " << e.what() << std::endl;
+			return;
+		}
+		update->loaded = true;
+	}, [this,filename,update]() -> bool {
+		if (update->loaded) {
+			//the game looks sprites up by name as it goes, so every name it could ask for must still be there:
+			for (SpriteId id = 0; id < sprites.sprites.size(); ++id) {
+				if (update->sprites.find(sprites.hash(id)) == SpriteRegistry::InvalidSprite) {
+					std::string name(sprites.sprites[id].name, strnlen(sprites.sprites[id].name, SPRITE_NAME_LENGTH));
+					std::cerr << "Reloaded sprite table '" << filename << "' has no sprite '" << name << "'." << std::endl;
+					update->loaded = false;
+					break;
+				}
+			}
+		}
+		if (update->loaded) {
+			sprites = std::move(update->sprites);
+			std::cout << "Reloaded '" << filename << "': " << sprites.sprites.size() << " sprites." << std::endl;
+			if (on_sprites_reloaded) on_sprites_reloaded();
+		} else {
+			std::cerr << "Keeping the old sprite table." << std::endl;
+		}
+
+		sprites_busy = "";
+		if (sprites_next != "") reload_sprites(sprites_next);
+		return true;
+	});
+}
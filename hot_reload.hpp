@@ -0,0 +1,62 @@
+#pragma once
+
+#include "GL.hpp"
+#include "asset_loader.hpp"
+#include "file_watcher.hpp"
+#include "sprite_registry.hpp"
+
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Reloads the texture and sprite table while the game runs, when their files are rewritten.
+ * A new texture image is decoded (keeping its channels and bit depth, as AssetLoader::load_texture
+ * does) and compared with the texture's current contents on a loader worker, and only the
+ * HOT_RELOAD_TILE-square tiles that differ are uploaded again (merged into rectangles, a slice per
+ * upload step). A new sprite table is read and registered on a worker too, then replaces the old
+ * one in a single step between frames -- or not at all, if it can't be read or is missing a sprite
+ * the old one had.
+ */
+
+#define HOT_RELOAD_TILE 32
+
+struct HotReload {
+	//'loader', 'sprites' and texture 'tex' must outlive this object:
+	HotReload(AssetLoader &loader, GLuint tex, SpriteRegistry &sprites);
+
+	//watch 'filename' as the source of the texture (a PNG, lower-left origin in GL):
+	bool watch_texture(std::string const &filename);
+	//watch 'filename' as the source of the sprite table (a .atlas file, or else the old spriteBin.bin,
+	//which is converted using the texture's size):
+	bool watch_sprites(std::string const &filename);
+
+	//GL thread, once per frame: start reloading whatever changed (uploads happen in loader.upload()):
+	void poll();
+
+	//called on the GL thread after the texture was updated / after 'sprites' was replaced:
+	std::function< void() > on_texture_reloaded;
+	std::function< void() > on_sprites_reloaded;
+
+private:
+	AssetLoader &loader;
+	GLuint tex;
+	SpriteRegistry &sprites;
+	FileWatcher watcher;
+	std::vector< std::string > texture_files;
+	std::vector< std::string > sprite_files;
+
+	//what's in 'tex' (rows from the bottom), read back from GL the first time the texture is reloaded:
+	std::shared_ptr< PngImage > resident;
+
+	//one reload of each kind at a time; a change noticed meanwhile is reloaded once that one is done:
+	std::string texture_busy, texture_next;
+	std::string sprites_busy, sprites_next;
+
+	void reload_texture(std::string const &filename);
+	void reload_sprites(std::string const &filename);
+};
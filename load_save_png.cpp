@@ -1,28 +1,48 @@
 #include "load_save_png.hpp"
+#include "load_save_qoi.hpp"
+#include "mapped_file.hpp"
+#include "pixel_convert.hpp"
 
 #include <png.h>
+#include <zlib.h>
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #define LOG_ERROR( X ) std::cerr << X << std::endl
 
+//rows per band when saving on several threads are chosen to make bands about this big (before compression):
+#define PNG_PARALLEL_BAND_BYTES (256 * 1024)
+
 using std::vector;
 
-bool load_png(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin) {
-	std::ifstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
+bool load_png(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
 		LOG_ERROR("  cannot open file.");
 		return false;
 	}
-	return load_png(file, width, height, data, origin);
+	return load_png(file.data, file.size, width, height, data, origin, flags);
 }
 
-void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin) {
+bool save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngSaveOptions const &options) {
 	std::ofstream file(filename.c_str(), std::ios::binary);
-	save_png(file, width, height, data, origin);
+	if (!file) {
+		LOG_ERROR("Can't open '" << filename << "' for writing.");
+		return false;
+	}
+	return save_png(file, width, height, data, origin, options) && file.flush();
 }
 
 
@@ -34,6 +54,22 @@ static void user_read_data(png_structp png_ptr, png_bytep data, png_size_t lengt
 	}
 }
 
+//read position in an in-memory PNG:
+struct ReadSpan {
+	png_const_bytep at;
+	png_const_bytep end;
+};
+
+static void span_read_data(png_structp png_ptr, png_bytep data, png_size_t length) {
+	ReadSpan *from = reinterpret_cast< ReadSpan * >(png_get_io_ptr(png_ptr));
+	assert(from);
+	if (length > png_size_t(from->end - from->at)) {
+		png_error(png_ptr, "Error reading (truncated).");
+	}
+	memcpy(data, from->at, length);
+	from->at += length;
+}
+
 static void user_write_data(png_structp png_ptr, png_bytep data, png_size_t length) {
 	std::ostream *to = reinterpret_cast< std::ostream * >(png_get_io_ptr(png_ptr));
 	assert(to);
@@ -51,18 +87,57 @@ static void user_flush_data(png_structp png_ptr) {
 }
 
 
-bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin) {
-	assert(data);
-	uint32_t local_width, local_height;
-	if (width == nullptr) width = &local_width;
-	if (height == nullptr) height = &local_height;
-	*width = *height = 0;
-	data->clear();
+static bool load_png_via(png_rw_ptr read_fn, void *io, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin, uint32_t flags);
+
+bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	return load_png_via(user_read_data, &from, width, height, data, origin, flags);
+}
+
+bool load_png(void const *bytes, size_t size, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	ReadSpan from;
+	from.at = reinterpret_cast< png_const_bytep >(bytes);
+	from.end = from.at + size;
+	return load_png_via(span_read_data, &from, width, height, data, origin, flags);
+}
+
+//RGBA palette entries (tRNS alpha, or 0xff) for all 256 indices; returns true if any entry is transparent:
+static bool read_palette(png_structp png, png_infop info, uint32_t palette[256]) {
+	png_colorp colors = NULL;
+	int color_count = 0;
+	png_get_PLTE(png, info, &colors, &color_count);
+	png_bytep trans = NULL;
+	int trans_count = 0;
+	if (png_get_valid(png, info, PNG_INFO_tRNS)) {
+		png_get_tRNS(png, info, &trans, &trans_count, NULL);
+	}
+	bool transparent = false;
+	for (int i = 0; i < 256; ++i) {
+		uint8_t *entry = reinterpret_cast< uint8_t * >(&palette[i]);
+		entry[0] = (i < color_count ? colors[i].red : 0);
+		entry[1] = (i < color_count ? colors[i].green : 0);
+		entry[2] = (i < color_count ? colors[i].blue : 0);
+		entry[3] = (i < trans_count ? trans[i] : 0xff);
+		if (i < color_count && entry[3] != 0xff) transparent = true;
+	}
+	return transparent;
+}
+
+//Where decode_rgba puts rows: 'begin' gets the image size, then rows are decoded in bands of 'band_rows'
+//(in file order, top first); 'row' gives where each row goes, and 'end_band' is called once a band is complete.
+//'begin' or 'end_band' can return false to stop decoding:
+struct RowSink {
+	std::function< bool(unsigned int width, unsigned int height) > begin;
+	std::function< uint32_t *(unsigned int r) > row;
+	std::function< bool(unsigned int first, unsigned int count) > end_band;
+	unsigned int band_rows = 0; //0: the whole image is one band
+};
+
+static bool decode_rgba(png_rw_ptr read_fn, void *io, RowSink const &sink, uint32_t flags) {
 	//..... load file ......
 	//Load a png file, as per the libpng docs:
 	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
 
-	png_set_read_fn(png, &from, user_read_data);
+	png_set_read_fn(png, io, read_fn);
 
 	if (!png) {
 		LOG_ERROR("  cannot alloc read struct.");
@@ -74,55 +149,312 @@ bool load_png(std::istream &from, unsigned int *width, unsigned int *height, vec
 		png_destroy_read_struct(&png, (png_infopp)NULL, (png_infopp)NULL);
 		return false;
 	}
-	png_bytep *row_pointers = NULL;
+	//Scratch space is per-thread and kept between calls, so loading many small images doesn't allocate per image.
+	//Non-interlaced images need one native row at a time; interlaced ones need them all, since passes build on
+	//each other -- but only for the one image, so that is given back afterwards (and after errors):
+	static thread_local vector< png_byte > native;
+	static thread_local vector< png_byte > expanded; //8-bit samples, for 16-bit and sub-byte images
 	if (setjmp(png_jmpbuf(png))) {
 		LOG_ERROR("  png interal error.");
 		png_destroy_read_struct(&png, &info, (png_infopp)NULL);
-		if (row_pointers != NULL) delete[] row_pointers;
-		data->clear();
+		vector< png_byte >().swap(native);
 		return false;
 	}
 	//not needed with custom read/write functions: png_init_io(png, NULL);
 	png_read_info(png, info);
 	unsigned int w = png_get_image_width(png, info);
 	unsigned int h = png_get_image_height(png, info);
-	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE)
-		png_set_palette_to_rgb(png);
-	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY || png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA)
-		png_set_gray_to_rgb(png);
-	if (!(png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA))
-		png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
-	if (png_get_bit_depth(png, info) < 8)
-		png_set_packing(png);
-	if (png_get_bit_depth(png,info) == 16)
-		png_set_strip_16(png);
-	//Ok, should be 32-bit RGBA now.
+	int color_type = png_get_color_type(png, info);
+	int bit_depth = png_get_bit_depth(png, info);
+	unsigned int channels = png_get_channels(png, info);
+
+	//Rows are decoded in their native layout and converted to RGBA by pixel_convert's kernels
+	//(rather than by libpng's per-pixel transforms); the results match what
+	//png_set_palette_to_rgb / gray_to_rgb / add_alpha / strip_16 would produce.
+	uint32_t palette[256];
+	if (color_type == PNG_COLOR_TYPE_PALETTE) read_palette(png, info, palette);
+
+	//(interlaced images are read as several passes over the same rows:)
+	int passes = png_set_interlace_handling(png);
 
 	png_read_update_info(png, info);
-	unsigned int rowbytes = png_get_rowbytes(png, info);
+	size_t rowbytes = png_get_rowbytes(png, info);
 	//Make sure it's the format we think it is...
-	assert(rowbytes == w*sizeof(uint32_t));
+	assert(rowbytes == (size_t(w) * channels * bit_depth + 7) / 8);
 
-	data->resize(w*h);
-	row_pointers = new png_bytep[h];
-	for (unsigned int r = 0; r < h; ++r) {
-		if (origin == LowerLeftOrigin) {
-			row_pointers[h-1-r] = (png_bytep)(&(*data)[r*w]);
-		} else {
-			row_pointers[r] = (png_bytep)(&(*data)[r*w]);
+	if (!sink.begin(w, h)) {
+		png_destroy_read_struct(&png, &info, NULL);
+		return false;
+	}
+
+	size_t native_rows = (passes > 1 ? h : 1);
+	if (native.size() < rowbytes * native_rows) native.resize(rowbytes * native_rows);
+	if (bit_depth != 8 && expanded.size() < size_t(w) * channels) expanded.resize(size_t(w) * channels);
+
+	auto convert_row = [&](png_const_bytep row, uint32_t *out) {
+		if (bit_depth == 16) {
+			convert_strip_16(row, expanded.data(), size_t(w) * channels);
+			row = expanded.data();
+		} else if (bit_depth < 8) {
+			convert_unpack_bits(row, expanded.data(), w, bit_depth, color_type != PNG_COLOR_TYPE_PALETTE);
+			row = expanded.data();
+		}
+		if (color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+			memcpy(out, row, size_t(w) * 4);
+		} else if (color_type == PNG_COLOR_TYPE_RGB) {
+			convert_rgb_to_rgba(row, out, w);
+		} else if (color_type == PNG_COLOR_TYPE_GRAY) {
+			convert_gray_to_rgba(row, out, w);
+		} else if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+			convert_gray_alpha_to_rgba(row, out, w);
+		} else { //PNG_COLOR_TYPE_PALETTE
+			convert_palette_to_rgba(row, out, w, palette);
+		}
+		if (flags & PngLoadPremultiplied) convert_premultiply(out, w);
+		if (flags & PngLoadBGRA) convert_swizzle_bgra(out, w);
+	};
+
+	if (passes > 1) {
+		for (int pass = 0; pass < passes; ++pass) {
+			for (unsigned int r = 0; r < h; ++r) {
+				png_read_row(png, native.data() + r * rowbytes, NULL);
+			}
+		}
+	}
+	unsigned int band_rows = (sink.band_rows ? sink.band_rows : std::max(h, 1u));
+	for (unsigned int first = 0; first < h; first += band_rows) {
+		unsigned int count = std::min(band_rows, h - first);
+		for (unsigned int r = first; r < first + count; ++r) {
+			png_bytep row = native.data();
+			if (passes > 1) row += r * rowbytes;
+			else png_read_row(png, row, NULL);
+			convert_row(row, sink.row(r));
+		}
+		if (!sink.end_band(first, count)) {
+			png_destroy_read_struct(&png, &info, NULL);
+			if (passes > 1) vector< png_byte >().swap(native);
+			return false;
 		}
 	}
-	png_read_image(png, row_pointers);
 	png_destroy_read_struct(&png, &info, NULL);
-	delete[] row_pointers;
+	if (passes > 1) vector< png_byte >().swap(native);
+	return true;
+}
 
+static bool load_png_via(png_rw_ptr read_fn, void *io, unsigned int *width, unsigned int *height, vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	assert(data);
+	uint32_t local_width, local_height;
+	if (width == nullptr) width = &local_width;
+	if (height == nullptr) height = &local_height;
+	*width = *height = 0;
+	data->clear();
+
+	unsigned int w = 0, h = 0;
+	RowSink sink;
+	sink.begin = [&](unsigned int width_, unsigned int height_) {
+		w = width_;
+		h = height_;
+		data->resize(size_t(w) * h);
+		return true;
+	};
+	sink.row = [&](unsigned int r) {
+		return &(*data)[size_t(origin == LowerLeftOrigin ? h-1-r : r) * w];
+	};
+	sink.end_band = [](unsigned int, unsigned int) {
+		return true;
+	};
+	if (!decode_rgba(read_fn, io, sink, flags)) {
+		data->clear();
+		return false;
+	}
 	*width = w;
 	*height = h;
 	return true;
 }
 
+static bool load_png_rows_via(png_rw_ptr read_fn, void *io, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows, uint32_t flags) {
+	unsigned int w = 0, h = 0;
+	vector< uint32_t > band;
+	unsigned int band_first = 0, band_count = 0;
+	RowSink sink;
+	sink.band_rows = std::max(band_rows, 1u);
+	sink.begin = [&](unsigned int width_, unsigned int height_) {
+		w = width_;
+		h = height_;
+		band.resize(size_t(w) * std::min(sink.band_rows, h));
+		return on_size(w, h);
+	};
+	sink.row = [&](unsigned int r) {
+		if (r == band_first + band_count) {
+			//(a new band is starting)
+			band_first = r;
+			band_count = std::min(sink.band_rows, h - r);
+		}
+		//within the band, rows are stored in 'origin' order:
+		unsigned int index = (origin == LowerLeftOrigin ? band_first + band_count - 1 - r : r - band_first);
+		return &band[size_t(index) * w];
+	};
+	sink.end_band = [&](unsigned int first, unsigned int count) {
+		return on_rows(origin == LowerLeftOrigin ? h - first - count : first, count, band.data());
+	};
+	return decode_rgba(read_fn, io, sink, flags);
+}
+
+bool load_png_rows(std::string filename, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_png_rows(file.data, file.size, on_size, on_rows, origin, band_rows, flags);
+}
+
+bool load_png_rows(void const *bytes, size_t size, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows, uint32_t flags) {
+	ReadSpan from;
+	from.at = reinterpret_cast< png_const_bytep >(bytes);
+	from.end = from.at + size;
+	return load_png_rows_via(span_read_data, &from, on_size, on_rows, origin, band_rows, flags);
+}
+
+static bool load_png_native_via(png_rw_ptr read_fn, void *io, PngImage *image, OriginLocation origin, uint32_t flags);
+
+bool load_png(std::string filename, PngImage *image, OriginLocation origin, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_png(file.data, file.size, image, origin, flags);
+}
+
+bool load_png(void const *bytes, size_t size, PngImage *image, OriginLocation origin, uint32_t flags) {
+	ReadSpan from;
+	from.at = reinterpret_cast< png_const_bytep >(bytes);
+	from.end = from.at + size;
+	return load_png_native_via(span_read_data, &from, image, origin, flags);
+}
+
+bool load_png(std::istream &from, PngImage *image, OriginLocation origin, uint32_t flags) {
+	return load_png_native_via(user_read_data, &from, image, origin, flags);
+}
+
+static bool load_png_native_via(png_rw_ptr read_fn, void *io, PngImage *image, OriginLocation origin, uint32_t flags) {
+	assert(image);
+	*image = PngImage();
+
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, (png_error_ptr)NULL, (png_error_ptr)NULL);
+	if (!png) {
+		LOG_ERROR("  cannot alloc read struct.");
+		return false;
+	}
+	png_set_read_fn(png, io, read_fn);
+	png_infop info = png_create_info_struct(png);
+	if (!info) {
+		LOG_ERROR("  cannot alloc info struct.");
+		png_destroy_read_struct(&png, (png_infopp)NULL, (png_infopp)NULL);
+		return false;
+	}
+	//the same per-thread scratch rows as the RGBA decode uses (and, the same way, only kept a row long):
+	static thread_local vector< png_byte > native;
+	static thread_local vector< png_byte > unpacked;
+	if (setjmp(png_jmpbuf(png))) {
+		LOG_ERROR("  png interal error.");
+		png_destroy_read_struct(&png, &info, (png_infopp)NULL);
+		vector< png_byte >().swap(native);
+		*image = PngImage();
+		return false;
+	}
+	png_read_info(png, info);
+	unsigned int w = png_get_image_width(png, info);
+	unsigned int h = png_get_image_height(png, info);
+	int color_type = png_get_color_type(png, info);
+	int bit_depth = png_get_bit_depth(png, info);
+	unsigned int channels = png_get_channels(png, info);
+
+	//16-bit samples are stored big-endian; GL wants them in the machine's order:
+	uint16_t const one = 1;
+	if (bit_depth == 16 && *reinterpret_cast< uint8_t const * >(&one) == 1) png_set_swap(png);
+	int passes = png_set_interlace_handling(png);
+	png_read_update_info(png, info);
+	size_t rowbytes = png_get_rowbytes(png, info);
+	assert(rowbytes == (size_t(w) * channels * bit_depth + 7) / 8);
+
+	image->width = w;
+	image->height = h;
+	image->channels = channels;
+	image->bit_depth = (bit_depth == 16 ? 16 : 8);
+	bool expand = false;
+	if (color_type == PNG_COLOR_TYPE_PALETTE) {
+		image->palette.resize(256);
+		bool transparent = read_palette(png, info, image->palette.data());
+		if (flags & PngLoadExpandPalette) {
+			expand = true;
+			image->channels = (transparent ? 4 : 3);
+			image->palette.clear();
+		}
+	}
+	size_t out_size = image->row_size();
+	image->data.resize(out_size * h);
+
+	size_t native_rows = (passes > 1 ? h : 1);
+	if (native.size() < rowbytes * native_rows) native.resize(rowbytes * native_rows);
+	if (unpacked.size() < w) unpacked.resize(w);
+
+	uint32_t palette[256];
+	if (expand) read_palette(png, info, palette);
+	auto convert_row = [&](png_const_bytep row, uint8_t *out) {
+		if (bit_depth < 8) {
+			convert_unpack_bits(row, unpacked.data(), w, bit_depth, color_type != PNG_COLOR_TYPE_PALETTE);
+			row = unpacked.data();
+		}
+		if (expand && image->channels == 4) {
+			convert_palette_to_rgba(row, reinterpret_cast< uint32_t * >(out), w, palette);
+		} else if (expand) {
+			convert_palette_to_rgb(row, out, w, palette);
+		} else if (row != out) {
+			memcpy(out, row, out_size);
+		}
+		if (image->channels == 4 && image->bit_depth == 8) {
+			if (flags & PngLoadPremultiplied) convert_premultiply(reinterpret_cast< uint32_t * >(out), w);
+			if (flags & PngLoadBGRA) convert_swizzle_bgra(reinterpret_cast< uint32_t * >(out), w);
+		}
+	};
+	auto out_row = [&](unsigned int r) {
+		return &image->data[(origin == LowerLeftOrigin ? h-1-r : r) * out_size];
+	};
+
+	if (passes == 1) {
+		for (unsigned int r = 0; r < h; ++r) {
+			//rows already in their final layout are decoded straight into place:
+			png_bytep row = (rowbytes == out_size ? out_row(r) : native.data());
+			png_read_row(png, row, NULL);
+			convert_row(row, out_row(r));
+		}
+	} else {
+		for (int pass = 0; pass < passes; ++pass) {
+			for (unsigned int r = 0; r < h; ++r) {
+				png_read_row(png, native.data() + r * rowbytes, NULL);
+			}
+		}
+		for (unsigned int r = 0; r < h; ++r) {
+			convert_row(native.data() + r * rowbytes, out_row(r));
+		}
+		vector< png_byte >().swap(native);
+	}
+	png_destroy_read_struct(&png, &info, NULL);
+	return true;
+}
+
+
+static bool save_png_parallel(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngSaveOptions const &options, uint32_t threads);
+
+bool save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngSaveOptions const &options) {
+	uint32_t threads = options.threads;
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	if (threads > 1 && size_t(height) * (size_t(width) * 4 + 1) >= 2 * PNG_PARALLEL_BAND_BYTES) {
+		return save_png_parallel(to, width, height, data, origin, options, threads);
+	}
 
-void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin) {
 //After the libpng example.c
 	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 
@@ -130,23 +462,35 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_
 
 	if (png_ptr == NULL) {
 		LOG_ERROR("Can't create write struct.");
-		return;
+		return false;
 	}
 
 	png_infop info_ptr = png_create_info_struct(png_ptr);
 	if (info_ptr == NULL) {
 		png_destroy_write_struct(&png_ptr, NULL);
 		LOG_ERROR("Can't craete info pointer");
-		return;
+		return false;
 	}
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
 		png_destroy_write_struct(&png_ptr, &info_ptr);
 		LOG_ERROR("Error writing png.");
-		return;
+		return false;
 	}
 
 	//Not needed with custom read/write functions: png_init_io(png_ptr, fp);
+	if (options.compression_level >= 0) {
+		png_set_compression_level(png_ptr, std::min(options.compression_level, 9));
+	}
+	if (options.strategy != PngStrategyDefault) {
+		png_set_compression_strategy(png_ptr,
+			options.strategy == PngStrategyFiltered ? Z_FILTERED
+			: options.strategy == PngStrategyHuffmanOnly ? Z_HUFFMAN_ONLY
+			: Z_RLE);
+	}
+	if (options.filters != 0) {
+		png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, options.filters & PNG_ALL_FILTERS);
+	}
 	png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
 	png_write_info(png_ptr, info_ptr);
@@ -165,5 +509,296 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_
 
 	png_destroy_write_struct(&png_ptr, &info_ptr);
 
-	return;
+	return bool(to);
+}
+
+//---- parallel encoding ----
+//pigz-style: rows are split into bands of about PNG_PARALLEL_BAND_BYTES, and each band is filtered and
+//deflated by its own thread, ending in a sync flush (so it stops on a byte boundary, without marking the
+//stream's end) so the pieces concatenate into one zlib stream. Each band starts with the last 32 KiB of
+//the band before as its dictionary, so matches still reach back across the seams.
+
+//paeth predictor, from the PNG spec:
+static inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+	int p = int(a) + int(b) - int(c);
+	int pa = std::abs(p - int(a)), pb = std::abs(p - int(b)), pc = std::abs(p - int(c));
+	if (pa <= pb && pa <= pc) return a;
+	if (pb <= pc) return b;
+	return c;
+}
+
+//filter an RGBA8 'row' (of 'size' bytes; 'prev' is the row above, or NULL for the first row) with
+//PNG filter 'type' (0-4) into 'out':
+static void filter_row(int type, uint8_t const *row, uint8_t const *prev, size_t size, uint8_t *out) {
+	if (!prev) {
+		//no row above: up is 0, average is half of left, paeth is left
+		if (type == 2) type = 0;
+		else if (type == 4) type = 1;
+	}
+	if (type == 0) {
+		memcpy(out, row, size);
+	} else if (type == 1) {
+		memcpy(out, row, std::min< size_t >(4, size));
+		for (size_t i = 4; i < size; ++i) out[i] = uint8_t(row[i] - row[i - 4]);
+	} else if (type == 2) {
+		for (size_t i = 0; i < size; ++i) out[i] = uint8_t(row[i] - prev[i]);
+	} else if (type == 3) {
+		for (size_t i = 0; i < std::min< size_t >(4, size); ++i) out[i] = uint8_t(row[i] - ((prev ? prev[i] : 0) >> 1));
+		for (size_t i = 4; i < size; ++i) out[i] = uint8_t(row[i] - ((int(row[i - 4]) + int(prev ? prev[i] : 0)) >> 1));
+	} else {
+		for (size_t i = 0; i < std::min< size_t >(4, size); ++i) out[i] = uint8_t(row[i] - prev[i]);
+		for (size_t i = 4; i < size; ++i) out[i] = uint8_t(row[i] - paeth(row[i - 4], prev[i], prev[i - 4]));
+	}
+}
+
+//filter type byte + filtered bytes for row 'r' (from the top) into 'out'; with more than one filter
+//allowed, picks the one whose output has the smallest sum of absolute (signed) values, as libpng does:
+static void encode_row(uint32_t const *data, unsigned int width, unsigned int height, OriginLocation origin, uint32_t filters, unsigned int r, uint8_t *out, std::vector< uint8_t > &scratch) {
+	auto row_at = [&](unsigned int i) {
+		return reinterpret_cast< uint8_t const * >(&data[size_t(origin == LowerLeftOrigin ? height - 1 - i : i) * width]);
+	};
+	uint8_t const *row = row_at(r);
+	uint8_t const *prev = (r > 0 ? row_at(r - 1) : NULL);
+	size_t size = size_t(width) * 4;
+
+	int only = -1;
+	for (int type = 0; type < 5; ++type) {
+		if (filters == (uint32_t(PngFilterNone) << type)) only = type;
+	}
+	if (only >= 0) {
+		out[0] = uint8_t(only);
+		filter_row(only, row, prev, size, out + 1);
+		return;
+	}
+	if (scratch.size() < size) scratch.resize(size);
+	uint64_t best = ~uint64_t(0);
+	for (int type = 0; type < 5; ++type) {
+		if (!(filters & (uint32_t(PngFilterNone) << type))) continue;
+		filter_row(type, row, prev, size, scratch.data());
+		uint64_t sum = 0;
+		for (size_t i = 0; i < size; ++i) {
+			sum += uint64_t(std::abs(int(int8_t(scratch[i]))));
+		}
+		if (sum < best) {
+			best = sum;
+			out[0] = uint8_t(type);
+			memcpy(out + 1, scratch.data(), size);
+		}
+	}
+}
+
+static void write_chunk(std::ostream &to, char const *type, uint8_t const *bytes, size_t size) {
+	uint8_t header[8] = {
+		uint8_t(size >> 24), uint8_t(size >> 16), uint8_t(size >> 8), uint8_t(size),
+		uint8_t(type[0]), uint8_t(type[1]), uint8_t(type[2]), uint8_t(type[3])
+	};
+	uLong crc = crc32(0L, header + 4, 4);
+	if (size) crc = crc32(crc, bytes, uInt(size));
+	uint8_t footer[4] = { uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc) };
+	to.write(reinterpret_cast< char const * >(header), 8);
+	if (size) to.write(reinterpret_cast< char const * >(bytes), size);
+	to.write(reinterpret_cast< char const * >(footer), 4);
+}
+
+static bool save_png_parallel(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngSaveOptions const &options, uint32_t threads) {
+	size_t row_size = size_t(width) * 4 + 1; //(with its filter type byte)
+	unsigned int band_rows = unsigned(std::max< size_t >(1, PNG_PARALLEL_BAND_BYTES / row_size));
+	unsigned int bands = (height + band_rows - 1) / band_rows;
+	uint32_t filters = (options.filters & PNG_ALL_FILTERS ? options.filters & PNG_ALL_FILTERS : PNG_ALL_FILTERS);
+	int level = (options.compression_level >= 0 ? std::min(options.compression_level, 9) : Z_DEFAULT_COMPRESSION);
+	//(as in libpng: Z_FILTERED by default, unless rows aren't filtered)
+	int strategy = (options.strategy == PngStrategyFiltered ? Z_FILTERED
+		: options.strategy == PngStrategyHuffmanOnly ? Z_HUFFMAN_ONLY
+		: options.strategy == PngStrategyRLE ? Z_RLE
+		: filters == PngFilterNone ? Z_DEFAULT_STRATEGY : Z_FILTERED);
+
+	struct Band {
+		std::vector< uint8_t > deflated;
+		uLong adler = 1;
+		size_t raw_size = 0;
+		bool ok = false;
+	};
+	std::vector< Band > results(bands);
+	std::atomic< unsigned int > next_band(0);
+
+	auto worker = [&]() {
+		std::vector< uint8_t > raw, scratch;
+		while (true) {
+			unsigned int band = next_band++;
+			if (band >= bands) break;
+			Band &result = results[band];
+			unsigned int first = band * band_rows;
+			unsigned int count = std::min(band_rows, height - first);
+			//rows of the band before, to fill the dictionary:
+			unsigned int dictionary_rows = std::min< unsigned int >(first, unsigned((32768 + row_size - 1) / row_size));
+			unsigned int from = first - dictionary_rows;
+			raw.resize(size_t(first + count - from) * row_size);
+			for (unsigned int r = from; r < first + count; ++r) {
+				encode_row(data, width, height, origin, filters, r, &raw[size_t(r - from) * row_size], scratch);
+			}
+			uint8_t *band_bytes = &raw[size_t(dictionary_rows) * row_size];
+			result.raw_size = size_t(count) * row_size;
+			result.adler = adler32(1L, band_bytes, uInt(result.raw_size));
+
+			z_stream z;
+			memset(&z, 0, sizeof(z));
+			if (deflateInit2(&z, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) continue;
+			if (dictionary_rows) {
+				size_t dictionary_size = std::min< size_t >(32768, size_t(dictionary_rows) * row_size);
+				deflateSetDictionary(&z, band_bytes - dictionary_size, uInt(dictionary_size));
+			}
+			result.deflated.resize(deflateBound(&z, uLong(result.raw_size)) + 16);
+			z.next_in = band_bytes;
+			z.avail_in = uInt(result.raw_size);
+			z.next_out = result.deflated.data();
+			z.avail_out = uInt(result.deflated.size());
+			int flush = (band + 1 == bands ? Z_FINISH : Z_SYNC_FLUSH);
+			int ret = deflate(&z, flush);
+			while ((flush == Z_FINISH ? ret != Z_STREAM_END : (z.avail_in != 0 || z.avail_out == 0)) && ret != Z_STREAM_ERROR) {
+				size_t used = result.deflated.size() - z.avail_out;
+				result.deflated.resize(result.deflated.size() * 2);
+				z.next_out = result.deflated.data() + used;
+				z.avail_out = uInt(result.deflated.size() - used);
+				ret = deflate(&z, flush);
+			}
+			result.deflated.resize(result.deflated.size() - z.avail_out);
+			result.ok = (ret != Z_STREAM_ERROR);
+			deflateEnd(&z);
+		}
+	};
+	std::vector< std::thread > pool;
+	for (uint32_t i = 1; i < std::min(threads, bands); ++i) {
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (auto &thread : pool) {
+		thread.join();
+	}
+
+	static uint8_t const signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+	to.write(reinterpret_cast< char const * >(signature), 8);
+	uint8_t ihdr[13] = {
+		uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+		uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+		8, 6, 0, 0, 0 //8-bit RGBA, deflate, adaptive filtering, not interlaced
+	};
+	write_chunk(to, "IHDR", ihdr, sizeof(ihdr));
+
+	//zlib header (32K window, deflate; FLEVEL as zlib would set it), then the bands, then the adler32 of it all:
+	int flevel = (level == Z_DEFAULT_COMPRESSION || level == 6 ? 2 : level < 2 || strategy >= Z_HUFFMAN_ONLY ? 0 : level < 6 ? 1 : 3);
+	uint8_t zlib_header[2] = {0x78, uint8_t(flevel << 6)};
+	zlib_header[1] |= uint8_t(31 - (zlib_header[0] * 256 + zlib_header[1]) % 31);
+	uLong adler = 1;
+	for (unsigned int band = 0; band < bands; ++band) {
+		Band &result = results[band];
+		if (!result.ok) {
+			LOG_ERROR("Error compressing png.");
+			return false;
+		}
+		adler = adler32_combine(adler, result.adler, z_off_t(result.raw_size));
+		std::vector< uint8_t > &idat = result.deflated;
+		if (band == 0) idat.insert(idat.begin(), zlib_header, zlib_header + 2);
+		if (band + 1 == bands) {
+			uint8_t trailer[4] = { uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler) };
+			idat.insert(idat.end(), trailer, trailer + 4);
+		}
+		write_chunk(to, "IDAT", idat.data(), idat.size());
+		std::vector< uint8_t >().swap(idat);
+	}
+	write_chunk(to, "IEND", NULL, 0);
+	return bool(to);
+}
+
+static_assert(PngFilterNone == PNG_FILTER_NONE && PngFilterSub == PNG_FILTER_SUB && PngFilterUp == PNG_FILTER_UP
+	&& PngFilterAvg == PNG_FILTER_AVG && PngFilterPaeth == PNG_FILTER_PAETH, "PngFilter bits match libpng's.");
+
+
+//background saving: one worker thread, started on first use, drains a queue of saves in order:
+namespace {
+struct SaveQueue {
+	struct Save {
+		std::string filename;
+		unsigned int width, height;
+		std::vector< uint32_t > data;
+		OriginLocation origin;
+		PngSaveOptions options;
+		std::promise< bool > result;
+	};
+
+	SaveQueue() : thread(&SaveQueue::worker, this) { }
+	~SaveQueue() {
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			quit = true;
+		}
+		changed.notify_all();
+		thread.join(); //(after writing whatever is still queued)
+	}
+
+	std::future< bool > push(Save &&save) {
+		std::future< bool > ret = save.result.get_future();
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			todo.emplace_back(std::move(save));
+		}
+		changed.notify_all();
+		return ret;
+	}
+
+	void flush() {
+		std::unique_lock< std::mutex > lock(mutex);
+		changed.wait(lock, [this](){ return todo.empty() && !writing; });
+	}
+
+	void worker() {
+		std::unique_lock< std::mutex > lock(mutex);
+		while (true) {
+			changed.wait(lock, [this](){ return quit || !todo.empty(); });
+			if (todo.empty()) return; //(quit)
+			Save save = std::move(todo.front());
+			todo.pop_front();
+			writing = true;
+			lock.unlock();
+			bool qoi = (save.filename.size() >= 4 && save.filename.compare(save.filename.size() - 4, 4, ".qoi") == 0);
+			bool ok = (qoi ? save_qoi(save.filename, save.width, save.height, save.data.data(), save.origin)
+				: save_png(save.filename, save.width, save.height, save.data.data(), save.origin, save.options));
+			save.result.set_value(ok);
+			lock.lock();
+			writing = false;
+			changed.notify_all();
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque< Save > todo;
+	bool writing = false;
+	bool quit = false;
+	std::thread thread; //(last, so everything it uses exists before it starts)
+};
+
+SaveQueue &save_queue() {
+	static SaveQueue queue;
+	return queue;
+}
+}
+
+std::future< bool > save_png_async(std::string filename, unsigned int width, unsigned int height, std::vector< uint32_t > &&data, OriginLocation origin, PngSaveOptions const &options) {
+	assert(data.size() == size_t(width) * size_t(height));
+	SaveQueue::Save save;
+	save.filename = filename;
+	save.width = width;
+	save.height = height;
+	save.data = std::move(data);
+	save.origin = origin;
+	save.options = options;
+	return save_queue().push(std::move(save));
+}
+
+std::future< bool > save_png_async(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngSaveOptions const &options) {
+	return save_png_async(filename, width, height, std::vector< uint32_t >(data, data + size_t(width) * size_t(height)), origin, options);
+}
+
+void save_png_flush() {
+	save_queue().flush();
 }
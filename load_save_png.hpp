@@ -2,10 +2,19 @@
 
 #include <string>
 #include <vector>
+#include <future>
+#include <functional>
+#include <cstddef>
 #include <stdint.h>
 
 /*
  * Load and save PNG files.
+ * Loading from a filename maps the file and decodes it in place (no stream in between).
+ * Pixels are 8-bit RGBA: rows are decoded in their PNG's own layout and expanded with the
+ * SIMD kernels in pixel_convert.hpp, which can also premultiply alpha or swizzle to BGRA on the way.
+ * Or, loading into a PngImage, pixels keep the PNG's channels and bit depth (see texture_format.hpp
+ * for uploading those to GL as they are).
+ * Saving can also be handed off to a background thread, so callers never wait on zlib.
  */
 
 enum OriginLocation {
@@ -13,8 +22,79 @@ enum OriginLocation {
 	UpperLeftOrigin,
 };
 
-bool load_png(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin);
-void save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin);
+//load_png options (bits):
+enum PngLoadFlags {
+	PngLoadPremultiplied = 1, //multiply color by alpha
+	PngLoadBGRA = 2, //store pixels as B,G,R,A bytes instead of R,G,B,A
+	PngLoadExpandPalette = 4, //(PngImage loads) look palette indices up, giving RGB, or RGBA if any entry is transparent
+};
+
+//an image in (nearly) the layout its PNG stores it in:
+struct PngImage {
+	unsigned int width = 0, height = 0;
+	unsigned int channels = 0; //1: gray (or palette indices), 2: gray + alpha, 3: RGB, 4: RGBA
+	unsigned int bit_depth = 0; //8 or 16 bits per sample (1-, 2- and 4-bit samples are unpacked to 8)
+	//for palette indices: 256 RGBA entries (as the RGBA load_png would give them), so any index is valid:
+	std::vector< uint32_t > palette;
+	//rows of width * channels samples, tightly packed; 16-bit samples are in this machine's byte order:
+	std::vector< uint8_t > data;
+
+	size_t row_size() const { return size_t(width) * channels * (bit_depth / 8); }
+};
+
+//encoder settings for save_png; the defaults are libpng's:
+enum PngStrategy {
+	PngStrategyDefault,
+	PngStrategyFiltered,    //tuned for filtered rows (libpng's usual choice when filtering)
+	PngStrategyHuffmanOnly, //no string matching: fast, bigger files
+	PngStrategyRLE,         //runs only: fast, good on flat-colored art
+};
+enum PngFilter { //row filters libpng may choose between (bits, same values as PNG_FILTER_*):
+	PngFilterNone = 0x08,
+	PngFilterSub = 0x10,
+	PngFilterUp = 0x20,
+	PngFilterAvg = 0x40,
+	PngFilterPaeth = 0x80,
+};
+struct PngSaveOptions {
+	int compression_level = -1; //zlib level, 0 (store) to 9 (smallest); -1 is zlib's default (6)
+	PngStrategy strategy = PngStrategyDefault;
+	uint32_t filters = 0; //PngFilter bits; 0 lets libpng choose adaptively from all of them
+	//deflate bands of rows on this many threads (0: one per core) -- for offline tools writing big images;
+	//the result is still one ordinary PNG, a little bigger than a single-threaded one. Images too small to
+	//split are always written by libpng:
+	uint32_t threads = 1;
+};
+
+bool load_png(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags = 0);
+bool save_png(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngSaveOptions const &options = PngSaveOptions());
+
+//decode a PNG that is already in memory (e.g. a mapped file, or a member of an archive); 'bytes' is not copied:
+bool load_png(void const *bytes, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin, uint32_t flags = 0);
+
+bool load_png(std::istream &from, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin, uint32_t flags = 0);
+
+//streaming decode, for images too big to want in memory whole: 'on_size' is called with the image size,
+//then 'on_rows' with each band of up to 'band_rows' decoded RGBA rows, reused between calls: rows
+//y .. y+count-1 (in 'origin' coordinates), stored from row y on, 'width' pixels each. Bands come in the
+//file's order, top first (so with LowerLeftOrigin, y decreases from band to band). Either callback can
+//return false to stop (load_png_rows then returns false). Interlaced PNGs still need all their packed
+//rows in memory before the first band is done, since later passes fill in earlier rows:
+typedef std::function< bool(unsigned int width, unsigned int height) > PngSizeCallback;
+typedef std::function< bool(unsigned int y, unsigned int count, uint32_t const *rows) > PngRowsCallback;
+bool load_png_rows(std::string filename, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows = 64, uint32_t flags = 0);
+bool load_png_rows(void const *bytes, size_t size, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows = 64, uint32_t flags = 0);
+
+//decode without expanding to RGBA (PngLoadPremultiplied and PngLoadBGRA apply to 8-bit RGBA images only):
+bool load_png(std::string filename, PngImage *image, OriginLocation origin, uint32_t flags = 0);
+bool load_png(void const *bytes, size_t size, PngImage *image, OriginLocation origin = UpperLeftOrigin, uint32_t flags = 0);
+bool load_png(std::istream &from, PngImage *image, OriginLocation origin = UpperLeftOrigin, uint32_t flags = 0);
+bool save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin, PngSaveOptions const &options = PngSaveOptions());
 
-bool load_png(std::istream &from, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin);
-void save_png(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin);
+//encode and write on a background thread, returning at once; the pixels are moved in (or copied, given a pointer).
+//Saves are written in the order they were queued; the future reports whether the save worked.
+//Filenames ending in ".qoi" are written as QOI instead (see load_save_qoi.hpp; 'options' are then unused):
+std::future< bool > save_png_async(std::string filename, unsigned int width, unsigned int height, std::vector< uint32_t > &&data, OriginLocation origin, PngSaveOptions const &options = PngSaveOptions());
+std::future< bool > save_png_async(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin, PngSaveOptions const &options = PngSaveOptions());
+//block until every queued save has been written (also happens automatically at exit):
+void save_png_flush();
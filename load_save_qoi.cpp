@@ -0,0 +1,375 @@
+#include "load_save_qoi.hpp"
+#include "mapped_file.hpp"
+#include "pixel_convert.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstring>
+
+#define LOG_ERROR( X ) std::cerr << X << std::endl
+
+//chunk tags, from the QOI specification:
+#define QOI_OP_INDEX 0x00 //00xxxxxx: pixel from the index
+#define QOI_OP_DIFF  0x40 //01rrggbb: small change from the previous pixel
+#define QOI_OP_LUMA  0x80 //10gggggg rrrrbbbb: change in green, and red and blue relative to it
+#define QOI_OP_RUN   0xc0 //11xxxxxx: previous pixel, repeated 1-62 times
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+
+#define QOI_HEADER_SIZE 14
+#define QOI_END_SIZE 8 //seven 0x00 and a 0x01
+//(as in the reference implementation; also keeps width * height * 4 comfortably inside a size_t)
+#define QOI_PIXELS_MAX 400000000u
+
+//encoded pixels are buffered in chunks about this big on their way to the stream:
+#define QOI_WRITE_BUFFER (64 * 1024)
+
+static inline uint32_t qoi_hash(uint8_t const *px) {
+	return (px[0] * 3u + px[1] * 5u + px[2] * 7u + px[3] * 11u) % 64u;
+}
+
+static inline uint32_t read_be32(uint8_t const *at) {
+	return (uint32_t(at[0]) << 24) | (uint32_t(at[1]) << 16) | (uint32_t(at[2]) << 8) | uint32_t(at[3]);
+}
+
+bool is_qoi(void const *bytes, size_t size) {
+	return size >= 4 && memcmp(bytes, "qoif", 4) == 0;
+}
+
+struct QoiHeader {
+	uint32_t width = 0, height = 0;
+	uint32_t channels = 0;
+};
+
+static bool read_header(uint8_t const *bytes, size_t size, QoiHeader *header) {
+	if (size < QOI_HEADER_SIZE + QOI_END_SIZE || !is_qoi(bytes, size)) {
+		LOG_ERROR("  not a QOI file.");
+		return false;
+	}
+	header->width = read_be32(bytes + 4);
+	header->height = read_be32(bytes + 8);
+	header->channels = bytes[12];
+	uint8_t colorspace = bytes[13];
+	if (header->width == 0 || header->height == 0
+	 || header->height >= QOI_PIXELS_MAX / header->width
+	 || (header->channels != 3 && header->channels != 4)
+	 || colorspace > 1) {
+		LOG_ERROR("  bad QOI header.");
+		return false;
+	}
+	return true;
+}
+
+//decoder state carried from one row to the next:
+struct QoiDecoder {
+	QoiDecoder(uint8_t const *at_, uint8_t const *end_) : at(at_), end(end_ - QOI_END_SIZE) {
+		memset(index, 0, sizeof(index));
+	}
+	uint8_t const *at;
+	uint8_t const *end; //(where the end marker starts)
+	uint8_t index[64 * 4];
+	uint8_t px[4] = {0, 0, 0, 0xff};
+	uint32_t run = 0;
+};
+
+//decode the next row of 'width' 'C'-byte pixels (R,G,B[,A]); false if the chunks run out:
+template< unsigned int C >
+static bool decode_row(QoiDecoder &dec, uint32_t width, uint8_t *row) {
+	//(the state is worked on in locals, which the compiler can keep in registers)
+	uint8_t const *at = dec.at;
+	uint8_t const *end = dec.end;
+	uint8_t *index = dec.index;
+	uint8_t px[4];
+	memcpy(px, dec.px, 4);
+	uint32_t run = dec.run;
+	for (uint32_t x = 0; x < width; ++x) {
+		if (run) {
+			--run;
+		} else {
+			if (at >= end) return false;
+			uint8_t b1 = *at++;
+			if (b1 == QOI_OP_RGB) {
+				if (end - at < 3) return false;
+				px[0] = at[0]; px[1] = at[1]; px[2] = at[2];
+				at += 3;
+			} else if (b1 == QOI_OP_RGBA) {
+				if (end - at < 4) return false;
+				memcpy(px, at, 4);
+				at += 4;
+			} else if ((b1 & 0xc0) == QOI_OP_INDEX) {
+				memcpy(px, &index[b1 * 4], 4);
+			} else if ((b1 & 0xc0) == QOI_OP_DIFF) {
+				px[0] = uint8_t(px[0] + ((b1 >> 4) & 0x03) - 2);
+				px[1] = uint8_t(px[1] + ((b1 >> 2) & 0x03) - 2);
+				px[2] = uint8_t(px[2] + (b1 & 0x03) - 2);
+			} else if ((b1 & 0xc0) == QOI_OP_LUMA) {
+				if (at >= end) return false;
+				uint8_t b2 = *at++;
+				int vg = int(b1 & 0x3f) - 32;
+				px[0] = uint8_t(px[0] + vg - 8 + ((b2 >> 4) & 0x0f));
+				px[1] = uint8_t(px[1] + vg);
+				px[2] = uint8_t(px[2] + vg - 8 + (b2 & 0x0f));
+			} else { //QOI_OP_RUN
+				run = (b1 & 0x3f);
+			}
+			memcpy(&index[qoi_hash(px) * 4], px, 4);
+		}
+		memcpy(row + x * C, px, C);
+	}
+	dec.at = at;
+	memcpy(dec.px, px, 4);
+	dec.run = run;
+	return true;
+}
+
+//decode the chunks after the header into rows of 'C'-byte pixels, tightly packed; false if they run out:
+template< unsigned int C >
+static bool decode_pixels(uint8_t const *at, uint8_t const *end, QoiHeader const &header, uint8_t *out, OriginLocation origin) {
+	QoiDecoder dec(at, end);
+	size_t row_size = size_t(header.width) * C;
+	for (uint32_t y = 0; y < header.height; ++y) {
+		uint8_t *row = out + size_t(origin == LowerLeftOrigin ? header.height - 1 - y : y) * row_size;
+		if (!decode_row< C >(dec, header.width, row)) return false;
+	}
+	return true;
+}
+
+bool load_qoi(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_qoi(file.data, file.size, width, height, data, origin, flags);
+}
+
+bool load_qoi(void const *bytes, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	assert(data);
+	uint32_t local_width, local_height;
+	if (width == nullptr) width = &local_width;
+	if (height == nullptr) height = &local_height;
+	*width = *height = 0;
+	data->clear();
+
+	uint8_t const *at = reinterpret_cast< uint8_t const * >(bytes);
+	QoiHeader header;
+	if (!read_header(at, size, &header)) return false;
+	//(RGB files still decode to RGBA: alpha just stays 0xff)
+	data->resize(size_t(header.width) * header.height);
+	if (!decode_pixels< 4 >(at + QOI_HEADER_SIZE, at + size, header, reinterpret_cast< uint8_t * >(data->data()), origin)) {
+		LOG_ERROR("  QOI data ends early.");
+		data->clear();
+		return false;
+	}
+	if (flags & PngLoadPremultiplied) convert_premultiply(data->data(), data->size());
+	if (flags & PngLoadBGRA) convert_swizzle_bgra(data->data(), data->size());
+	*width = header.width;
+	*height = header.height;
+	return true;
+}
+
+bool load_qoi_rows(std::string filename, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_qoi_rows(file.data, file.size, on_size, on_rows, origin, band_rows, flags);
+}
+
+bool load_qoi_rows(void const *bytes, size_t size, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows, uint32_t flags) {
+	uint8_t const *at = reinterpret_cast< uint8_t const * >(bytes);
+	QoiHeader header;
+	if (!read_header(at, size, &header)) return false;
+	if (!on_size(header.width, header.height)) return false;
+
+	//bands as load_png_rows makes them: file order (top first), rows within a band in 'origin' order:
+	uint32_t w = header.width, h = header.height;
+	band_rows = std::max(band_rows, 1u);
+	std::vector< uint32_t > band(size_t(w) * std::min(band_rows, h));
+	QoiDecoder dec(at + QOI_HEADER_SIZE, at + size);
+	for (uint32_t first = 0; first < h; first += band_rows) {
+		uint32_t count = std::min(band_rows, h - first);
+		for (uint32_t r = first; r < first + count; ++r) {
+			uint32_t *row = &band[size_t(origin == LowerLeftOrigin ? first + count - 1 - r : r - first) * w];
+			if (!decode_row< 4 >(dec, w, reinterpret_cast< uint8_t * >(row))) {
+				LOG_ERROR("  QOI data ends early.");
+				return false;
+			}
+			if (flags & PngLoadPremultiplied) convert_premultiply(row, w);
+			if (flags & PngLoadBGRA) convert_swizzle_bgra(row, w);
+		}
+		if (!on_rows(origin == LowerLeftOrigin ? h - first - count : first, count, band.data())) return false;
+	}
+	return true;
+}
+
+bool load_qoi(std::string filename, PngImage *image, OriginLocation origin) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_qoi(file.data, file.size, image, origin);
+}
+
+bool load_qoi(void const *bytes, size_t size, PngImage *image, OriginLocation origin) {
+	assert(image);
+	*image = PngImage();
+
+	uint8_t const *at = reinterpret_cast< uint8_t const * >(bytes);
+	QoiHeader header;
+	if (!read_header(at, size, &header)) return false;
+	image->width = header.width;
+	image->height = header.height;
+	image->channels = header.channels;
+	image->bit_depth = 8;
+	image->data.resize(image->row_size() * image->height);
+	bool ok = (header.channels == 3
+		? decode_pixels< 3 >(at + QOI_HEADER_SIZE, at + size, header, image->data.data(), origin)
+		: decode_pixels< 4 >(at + QOI_HEADER_SIZE, at + size, header, image->data.data(), origin));
+	if (!ok) {
+		LOG_ERROR("  QOI data ends early.");
+		*image = PngImage();
+		return false;
+	}
+	return true;
+}
+
+bool save_qoi(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin) {
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file) {
+		LOG_ERROR("Can't open '" << filename << "' for writing.");
+		return false;
+	}
+	return save_qoi(file, width, height, data, origin) && file.flush();
+}
+
+bool save_qoi(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin) {
+	if (width == 0 || height == 0 || height >= QOI_PIXELS_MAX / width) {
+		LOG_ERROR("Can't save a " << width << "x" << height << " image as QOI.");
+		return false;
+	}
+
+	//(a pixel adds at most 6 bytes -- a run ending, then an RGBA chunk -- and the end adds 9 more,
+	//so checking for 'flush_at' once per pixel never lets the buffer overflow)
+	std::vector< uint8_t > buffer(QOI_WRITE_BUFFER + 16);
+	uint8_t *at = buffer.data();
+	uint8_t *flush_at = buffer.data() + QOI_WRITE_BUFFER;
+
+	uint8_t header[QOI_HEADER_SIZE] = {
+		'q', 'o', 'i', 'f',
+		uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+		uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+		4, 0 //RGBA, sRGB with linear alpha
+	};
+	to.write(reinterpret_cast< char const * >(header), QOI_HEADER_SIZE);
+
+	uint8_t index[64 * 4];
+	memset(index, 0, sizeof(index));
+	uint8_t prev[4] = {0, 0, 0, 0xff};
+	uint32_t run = 0;
+	for (uint32_t y = 0; y < height; ++y) {
+		uint8_t const *row = reinterpret_cast< uint8_t const * >(data + size_t(origin == LowerLeftOrigin ? height - 1 - y : y) * width);
+		for (uint32_t x = 0; x < width; ++x) {
+			uint8_t const *px = row + x * 4;
+			if (at >= flush_at) {
+				to.write(reinterpret_cast< char const * >(buffer.data()), at - buffer.data());
+				at = buffer.data();
+			}
+			if (memcmp(px, prev, 4) == 0) {
+				run += 1;
+				if (run == 62) {
+					*(at++) = uint8_t(QOI_OP_RUN | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+			if (run) {
+				*(at++) = uint8_t(QOI_OP_RUN | (run - 1));
+				run = 0;
+			}
+
+			uint32_t hash = qoi_hash(px);
+			if (memcmp(&index[hash * 4], px, 4) == 0) {
+				*(at++) = uint8_t(QOI_OP_INDEX | hash);
+			} else {
+				memcpy(&index[hash * 4], px, 4);
+				if (px[3] == prev[3]) {
+					int vr = int8_t(px[0] - prev[0]);
+					int vg = int8_t(px[1] - prev[1]);
+					int vb = int8_t(px[2] - prev[2]);
+					int vg_r = vr - vg;
+					int vg_b = vb - vg;
+					if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+						*(at++) = uint8_t(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+					} else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+						*(at++) = uint8_t(QOI_OP_LUMA | (vg + 32));
+						*(at++) = uint8_t(((vg_r + 8) << 4) | (vg_b + 8));
+					} else {
+						*(at++) = QOI_OP_RGB;
+						*(at++) = px[0]; *(at++) = px[1]; *(at++) = px[2];
+					}
+				} else {
+					*(at++) = QOI_OP_RGBA;
+					memcpy(at, px, 4);
+					at += 4;
+				}
+			}
+			memcpy(prev, px, 4);
+		}
+	}
+	if (run) {
+		*(at++) = uint8_t(QOI_OP_RUN | (run - 1));
+	}
+	static uint8_t const end[QOI_END_SIZE] = {0, 0, 0, 0, 0, 0, 0, 1};
+	memcpy(at, end, QOI_END_SIZE);
+	at += QOI_END_SIZE;
+	to.write(reinterpret_cast< char const * >(buffer.data()), at - buffer.data());
+	return bool(to);
+}
+
+bool load_image(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	return load_image(file.data, file.size, width, height, data, origin, flags);
+}
+
+bool load_image(void const *bytes, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags) {
+	if (is_qoi(bytes, size)) {
+		return load_qoi(bytes, size, width, height, data, origin, flags);
+	} else {
+		return load_png(bytes, size, width, height, data, origin, flags);
+	}
+}
+
+bool load_image(std::string filename, PngImage *image, OriginLocation origin, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	if (is_qoi(file.data, file.size)) {
+		return load_qoi(file.data, file.size, image, origin);
+	} else {
+		return load_png(file.data, file.size, image, origin, flags);
+	}
+}
+
+bool load_image_rows(std::string filename, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows, uint32_t flags) {
+	MappedFile file;
+	if (!file.open(filename)) {
+		LOG_ERROR("  cannot open file.");
+		return false;
+	}
+	if (is_qoi(file.data, file.size)) {
+		return load_qoi_rows(file.data, file.size, on_size, on_rows, origin, band_rows, flags);
+	} else {
+		return load_png_rows(file.data, file.size, on_size, on_rows, origin, band_rows, flags);
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "load_save_png.hpp"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * Load and save QOI ("Quite OK Image", https://qoiformat.org) files, with the same pixel layout and
+ * OriginLocation handling as load_png / save_png.
+ * QOI is lossless and encodes or decodes in a single pass over the pixels with no entropy coder,
+ * so it is several times faster than PNG; on flat-colored sprite art files come out about as small.
+ * The game takes either format wherever it loads a texture (load_image, below, goes by the file's magic),
+ * and save_png_async writes QOI for filenames ending in ".qoi" (e.g. for frame captures).
+ */
+
+//true if 'bytes' start like a QOI file:
+bool is_qoi(void const *bytes, size_t size);
+
+//pixels as 8-bit RGBA, as from load_png (with the same PngLoadPremultiplied / PngLoadBGRA flags):
+bool load_qoi(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags = 0);
+bool load_qoi(void const *bytes, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin, uint32_t flags = 0);
+//or streamed in bands of RGBA rows, exactly as load_png_rows does (a QOI decode only ever holds one band):
+bool load_qoi_rows(std::string filename, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows = 64, uint32_t flags = 0);
+bool load_qoi_rows(void const *bytes, size_t size, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows = 64, uint32_t flags = 0);
+//or in the file's own channels (3: RGB, 4: RGBA; always 8-bit), for texture_format():
+bool load_qoi(std::string filename, PngImage *image, OriginLocation origin);
+bool load_qoi(void const *bytes, size_t size, PngImage *image, OriginLocation origin = UpperLeftOrigin);
+
+//always written with 4 channels (sRGB color, linear alpha):
+bool save_qoi(std::string filename, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin);
+bool save_qoi(std::ostream &to, unsigned int width, unsigned int height, uint32_t const *data, OriginLocation origin = UpperLeftOrigin);
+
+//load a PNG or a QOI file, whichever 'filename' holds ('flags' are PngLoadFlags, as for load_png):
+bool load_image(std::string filename, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin, uint32_t flags = 0);
+bool load_image(std::string filename, PngImage *image, OriginLocation origin, uint32_t flags = 0);
+bool load_image(void const *bytes, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data, OriginLocation origin = UpperLeftOrigin, uint32_t flags = 0);
+bool load_image_rows(std::string filename, PngSizeCallback const &on_size, PngRowsCallback const &on_rows, OriginLocation origin, unsigned int band_rows = 64, uint32_t flags = 0);
@@ -1,4 +1,13 @@
 #include "load_save_png.hpp"
+#include "load_save_qoi.hpp"
+#include "sprite_batch.hpp"
+#include "headless_context.hpp"
+#include "frame_profiler.hpp"
+#include "asset_bundle.hpp"
+#include "asset_cache.hpp"
+#include "asset_loader.hpp"
+#include "frame_capture.hpp"
+#include "hot_reload.hpp"
 #include "GL.hpp"
 
 #include <SDL.h>
@@ -9,95 +18,155 @@
 #include <iostream>
 #include <stdexcept>
 #include <fstream>
-
-static GLuint compile_shader(GLenum type, std::string const &source);
-static GLuint link_program(GLuint vertex_shader, GLuint fragment_shader);
+#include <memory>
+#include <algorithm>
+#include <cstring>
 
 int main(int argc, char **argv) {
 	//Configuration:
 	struct {
 		std::string title = "Game1: Make and Escape";
 		glm::uvec2 size = glm::uvec2(800, 600);
+		//--headless [frames] [output.png|output.qoi]: render offscreen (no display needed), then report timing:
+		bool headless = false;
+		uint32_t headless_frames = 100;
+		std::string headless_output = "";
+		//--capture prefix: save every frame drawn as prefix-NNNNN.png (F12 toggles this while running):
+		std::string capture_prefix = "";
+		//--capture-qoi: ...as prefix-NNNNN.qoi, which encodes several times faster:
+		std::string capture_extension = ".png";
 	} config;
 
+	for (int argi = 1; argi < argc; ++argi) {
+		if (strcmp(argv[argi], "--headless") == 0) {
+			config.headless = true;
+			if (argi + 1 < argc && argv[argi+1][0] != '-') {
+				config.headless_frames = std::max(1, atoi(argv[++argi]));
+			}
+			if (argi + 1 < argc && argv[argi+1][0] != '-') {
+				config.headless_output = argv[++argi];
+			}
+		} else if (strcmp(argv[argi], "--capture") == 0 && argi + 1 < argc) {
+			config.capture_prefix = argv[++argi];
+		} else if (strcmp(argv[argi], "--capture-qoi") == 0) {
+			config.capture_extension = ".qoi";
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--headless [frames] [output.png|output.qoi]] [--capture prefix] [--capture-qoi]" << std::endl;
+			return 1;
+		}
+	}
+
 	//------------  initialization ------------
 
-	//Initialize SDL library:
-	SDL_Init(SDL_INIT_VIDEO);
-
-	//Ask for an OpenGL context version 3.3, core profile, enable debug:
-	SDL_GL_ResetAttributes();
-	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
-
-	//create window:
-	SDL_Window *window = SDL_CreateWindow(
-		config.title.c_str(),
-		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-		config.size.x, config.size.y,
-		SDL_WINDOW_OPENGL /*| SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI*/
-	);
-
-	if (!window) {
-		std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
-		return 1;
-	}
+	SDL_Window *window = NULL;
+	SDL_GLContext context = 0;
+	std::unique_ptr< HeadlessContext > headless;
 
-	//Create OpenGL context:
-	SDL_GLContext context = SDL_GL_CreateContext(window);
+	if (config.headless) {
+		//Headless: no window; the draw loop renders into an offscreen framebuffer instead:
+		SDL_Init(SDL_INIT_EVENTS);
+		try {
+			headless.reset(new HeadlessContext(config.size));
+		} catch (std::exception &e) {
+			std::cerr << "Error creating headless context: " << e.what() << std::endl;
+			return 1;
+		}
+	} else {
+		//Initialize SDL library:
+		SDL_Init(SDL_INIT_VIDEO);
 
-	if (!context) {
-		SDL_DestroyWindow(window);
-		std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
-		return 1;
-	}
+		//Ask for an OpenGL context version 3.3, core profile, enable debug:
+		SDL_GL_ResetAttributes();
+		SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+		SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
-	#ifdef _WIN32
-	//On windows, load OpenGL extensions:
-	if (!init_gl_shims()) {
-		std::cerr << "ERROR: failed to initialize shims." << std::endl;
-		return 1;
-	}
-	#endif
+		//create window:
+		window = SDL_CreateWindow(
+			config.title.c_str(),
+			SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+			config.size.x, config.size.y,
+			SDL_WINDOW_OPENGL /*| SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI*/
+		);
+
+		if (!window) {
+			std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
+			return 1;
+		}
+
+		//Create OpenGL context:
+		context = SDL_GL_CreateContext(window);
 
-	//Set VSYNC + Late Swap (prevents crazy FPS):
-	if (SDL_GL_SetSwapInterval(-1) != 0) {
-		std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
-		if (SDL_GL_SetSwapInterval(1) != 0) {
-			std::cerr << "NOTE: couldn't set vsync (" << SDL_GetError() << ")." << std::endl;
+		if (!context) {
+			SDL_DestroyWindow(window);
+			std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
+			return 1;
 		}
+
+		#ifdef _WIN32
+		//On windows, load OpenGL extensions:
+		if (!init_gl_shims()) {
+			std::cerr << "ERROR: failed to initialize shims." << std::endl;
+			return 1;
+		}
+		#endif
+
+		//Set VSYNC + Late Swap (prevents crazy FPS):
+		if (SDL_GL_SetSwapInterval(-1) != 0) {
+			std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
+			if (SDL_GL_SetSwapInterval(1) != 0) {
+				std::cerr << "NOTE: couldn't set vsync (" << SDL_GetError() << ")." << std::endl;
+			}
+		}
+
+		//Hide mouse cursor (note: showing can be useful for debugging):
+		SDL_ShowCursor(SDL_DISABLE);
 	}
 
-	//Hide mouse cursor (note: showing can be useful for debugging):
-	SDL_ShowCursor(SDL_DISABLE);
+	//------------  teardown ------------
+	//(locals are destroyed in reverse order, so this runs after everything declared below that owns GL
+	// objects -- batch, profiler, capture, loader, hot_reload -- has deleted them with the context current)
+	struct Teardown {
+		SDL_Window *&window;
+		SDL_GLContext &context;
+		~Teardown() {
+			if (context) {
+				SDL_GL_DeleteContext(context);
+				context = 0;
+			}
+
+			if (window) {
+				SDL_DestroyWindow(window);
+				window = NULL;
+			}
+		}
+	} teardown{window, context};
 
 	//------------ opengl objects / game assets ------------
 
-	//texture:
+	//texture and sprite table, cooked into a bundle (see asset_cache.hpp) that is only remade when they change:
+	AssetBundle bundle;
+	bool sprites_loaded = false;
+	//set (on this thread, by an upload step) if the texture or sprite table can't be loaded at all;
+	//the game then stops the normal way, so everything is torn down in order:
+	bool assets_failed = false;
 	GLuint tex = 0;
-	glm::uvec2 tex_size = glm::uvec2(0,0);
 
-	{ //load texture 'tex':
-		std::vector< uint32_t > data;
-		if (!load_png("map.png", &tex_size.x, &tex_size.y, &data, LowerLeftOrigin)) {
-			std::cerr << "Failed to load texture." << std::endl;
-			exit(1);
-		}
-		//create a texture object:
+	//assets are decoded and parsed on worker threads (while this thread compiles shaders);
+	//their GL uploads happen here, in the main loop, a budgeted amount per frame:
+	AssetLoader loader;
+
+	{ //create texture 'tex' now, so it can be drawn with while its contents are still loading:
 		glGenTextures(1, &tex);
-		//bind texture object to GL_TEXTURE_2D:
 		glBindTexture(GL_TEXTURE_2D, tex);
-		//upload texture data from data:
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex_size.x, tex_size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, &data[0]);
 		//set texture sampling parameters:
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -105,145 +174,77 @@ int main(int argc, char **argv) {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	}
 
-	//shader program:
-	GLuint program = 0;
-	GLuint program_Position = 0;
-	GLuint program_TexCoord = 0;
-	GLuint program_Color = 0;
-	GLuint program_mvp = 0;
-	GLuint program_tex = 0;
-	{ //compile shader program:
-		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
-			"#version 330\n"
-			"uniform mat4 mvp;\n"
-			"in vec4 Position;\n"
-			"in vec2 TexCoord;\n"
-			"in vec4 Color;\n"
-			"out vec2 texCoord;\n"
-			"out vec4 color;\n"
-			"void main() {\n"
-			"	gl_Position = mvp * Position;\n"
-			"	color = Color;\n"
-			"	texCoord = TexCoord;\n"
-			"}\n"
-		);
-
-		GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER,
-			"#version 330\n"
-			"uniform sampler2D tex;\n"
-			"in vec4 color;\n"
-			"in vec2 texCoord;\n"
-			"out vec4 fragColor;\n"
-			"void main() {\n"
-			"	fragColor = texture(tex, texCoord) * color;\n"
-			"}\n"
-		);
-
-		program = link_program(fragment_shader, vertex_shader);
-
-		//look up attribute locations:
-		program_Position = glGetAttribLocation(program, "Position");
-		if (program_Position == -1U) throw std::runtime_error("no attribute named Position");
-		program_TexCoord = glGetAttribLocation(program, "TexCoord");
-		if (program_TexCoord == -1U) throw std::runtime_error("no attribute named TexCoord");
-		program_Color = glGetAttribLocation(program, "Color");
-		if (program_Color == -1U) throw std::runtime_error("no attribute named Color");
-
-		//look up uniform locations:
-		program_mvp = glGetUniformLocation(program, "mvp");
-		if (program_mvp == -1U) throw std::runtime_error("no uniform named mvp");
-		program_tex = glGetUniformLocation(program, "tex");
-		if (program_tex == -1U) throw std::runtime_error("no uniform named tex");
+	{ //load 'tex' and the sprite table:
+		std::shared_ptr< bool > have_bundle = std::make_shared< bool >(false);
+		//(the old spriteBin.bin is converted, if there's no sprites.atlas; a cook_bundle'd assets.bundle
+		// made from these same files counts as cached)
+		std::string sprites_file = (std::ifstream("sprites.atlas") ? "sprites.atlas" : "spriteBin.bin");
+		loader.run([&bundle,have_bundle,sprites_file](){
+			*have_bundle = load_cached_bundle("map.png", sprites_file, "cache", "assets.bundle", &bundle);
+			if (!*have_bundle) {
+				//couldn't cook (sources missing?); a bundle on its own will do:
+				*have_bundle = bundle.load("assets.bundle");
+			}
+		}, [&bundle,&loader,&sprites_loaded,&assets_failed,tex,have_bundle,sprites_file]() -> bool {
+			if (*have_bundle) {
+				//already decoded; upload straight from the mapping
+				//(rows are tightly packed RGBA8, so the default 4-byte unpack alignment is fine):
+				glBindTexture(GL_TEXTURE_2D, tex);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bundle.header->width, bundle.header->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, bundle.texels);
+				sprites_loaded = true;
+				return true;
+			}
+			std::cerr << "Couldn't cook or load assets; decoding map.png and '" << sprites_file << "' directly." << std::endl;
+			//(the sprite table is read once the texture's size is known, which spriteBin.bin needs)
+			loader.load_texture("map.png", tex, LowerLeftOrigin, [&bundle,&loader,&sprites_loaded,&assets_failed,sprites_file](glm::uvec2 size){
+				if (size.x == 0) {
+					std::cerr << "Failed to load texture." << std::endl;
+					assets_failed = true;
+					return;
+				}
+				std::shared_ptr< bool > have_atlas = std::make_shared< bool >(false);
+				loader.run([&bundle,have_atlas,sprites_file,size](){
+					if (sprites_file == "spriteBin.bin") {
+						*have_atlas = bundle.atlas.load_sprite_bin(sprites_file, size.x, size.y);
+					} else {
+						*have_atlas = bundle.atlas.load(sprites_file);
+					}
+				}, [&sprites_loaded,&assets_failed,have_atlas]() -> bool {
+					if (!*have_atlas) {
+						std::cerr << "Failed to load sprite atlas." << std::endl;
+						assets_failed = true;
+						return true;
+					}
+					sprites_loaded = true;
+					return true;
+				});
+			});
+			return true;
+		});
 	}
 
-	//vertex buffer:
-	GLuint buffer = 0;
-	{ //create vertex buffer
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	}
+	//sprite renderer (shader program, vertex buffers, and batching):
+	SpriteBatch batch;
 
-	struct Vertex {
-		Vertex(glm::vec2 const &Position_, glm::vec2 const &TexCoord_, glm::u8vec4 const &Color_) :
-			Position(Position_), TexCoord(TexCoord_), Color(Color_) { }
-		glm::vec2 Position;
-		glm::vec2 TexCoord;
-		glm::u8vec4 Color;
-	};
-	static_assert(sizeof(Vertex) == 20, "Vertex is nicely packed.");
-
-	//vertex array object:
-	GLuint vao = 0;
-	{ //create vao and set up binding:
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		glVertexAttribPointer(program_Position, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0);
-		glVertexAttribPointer(program_TexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + sizeof(glm::vec2));
-		glVertexAttribPointer(program_Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + sizeof(glm::vec2) + sizeof(glm::vec2));
-		glEnableVertexAttribArray(program_Position);
-		glEnableVertexAttribArray(program_TexCoord);
-		glEnableVertexAttribArray(program_Color);
-	}
+	//phase timings, shown as an overlay with F3:
+	FrameProfiler profiler;
+	bool show_profiler = false;
+
+	//frame capture (for footage / bug reports), toggled with F12:
+	FrameCapture capture;
+	bool capturing = (config.capture_prefix != "");
+	uint32_t capture_count = 0;
+	if (config.capture_prefix == "") config.capture_prefix = "capture";
 
 	//------------ sprite info ------------
-	struct SpriteInfo {
-		char name[20];
-		glm::vec2 min_uv = glm::vec2(4.0f / 500.0f, 115.0f / 240.f);
-		glm::vec2 max_uv = glm::vec2(163.0f / 500.0f, 234.0f / 240.0f);
-		glm::vec2 rad = glm::vec2(13.3f, 9.975f);
-	};
 
-#define SPRITE_NUM 80
-#define TEXTURE_MAP_SIZE_X 481
-#define TEXTURE_MAP_SIZE_Y 199
-	//read the sprite data from file
-	SpriteInfo sprite_list[SPRITE_NUM];
-	glm::vec2 screen_size;
-	{
-		std::ifstream fin ("spriteBin.bin", std::ifstream::binary);
-		for(int i=0;i<SPRITE_NUM;i++) {;
-			fin.read(reinterpret_cast<char*>(&sprite_list[i].name), sizeof(char) * 20);
-			//reference to https://stackoverflow.com/questions/19614581/reading-floating-numbers-from-bin-file-continuosly-and-outputting-in-console-win
-			fin.read(reinterpret_cast<char*>(&(sprite_list[i].min_uv.x)), sizeof(float));
-			fin.read(reinterpret_cast<char*>(&(sprite_list[i].max_uv.y)), sizeof(float));
-			fin.read(reinterpret_cast<char*>(&(sprite_list[i].max_uv.x)), sizeof(float));
-			fin.read(reinterpret_cast<char*>(&(sprite_list[i].min_uv.y)), sizeof(float));
-			sprite_list[i].min_uv.y = TEXTURE_MAP_SIZE_Y - sprite_list[i].min_uv.y;
-			sprite_list[i].max_uv.y = TEXTURE_MAP_SIZE_Y - sprite_list[i].max_uv.y;
-			if(i==0) {
-				screen_size = glm::vec2(sprite_list[i].max_uv.x - sprite_list[i].min_uv.x, sprite_list[i].max_uv.y - sprite_list[i].min_uv.y);
-			}
-			sprite_list[i].rad.x *= (sprite_list[i].max_uv.x - sprite_list[i].min_uv.x) / screen_size.x;
-			sprite_list[i].rad.y *= (sprite_list[i].max_uv.y - sprite_list[i].min_uv.y) / screen_size.y;
-			sprite_list[i].min_uv.x /= TEXTURE_MAP_SIZE_X;
-			sprite_list[i].min_uv.y /= TEXTURE_MAP_SIZE_Y;
-			sprite_list[i].max_uv.x /= TEXTURE_MAP_SIZE_X;
-			sprite_list[i].max_uv.y /= TEXTURE_MAP_SIZE_Y;
-			//printf("%s %f %f %f %f\n", sprite_list[i].name.c_str(), sprite_list[i].min_uv.x, sprite_list[i].min_uv.y, sprite_list[i].max_uv.x, sprite_list[i].max_uv.y);
-		}
-		fin.close();
-	}
+	//the sprite table is needed to set up the game (the texture may keep uploading over the first few frames):
+	loader.finish([&sprites_loaded,&assets_failed](){ return sprites_loaded || assets_failed; });
+	if (assets_failed) return 1;
 
-	auto load_sprite = [&](std::string const &name) -> SpriteInfo {
-		SpriteInfo info;
-		//TODO: look up sprite name in table of sprite infos
-		int i;
-		char n[20];
-		for(i=0;i<(int)name.length();i++) {
-			n[i] = name[i];
-		}
-		for(i=(int)name.length();i<20;i++) {
-			n[i] = '\0';
-		}
-		for(i=0; i<SPRITE_NUM;i++) {
-			if(strncmp(sprite_list[i].name, n, 20)==0) {
-				return sprite_list[i];
-			}
-		}
-		printf("cannot find sprite %s", name.c_str());
-		exit(1);
-		return info;
-	};
+	//sprites are looked up by name hash, e.g. sprites["player1"_sprite]:
+	SpriteRegistry sprites;
+	bundle.atlas.register_sprites(sprites);
 
 
 	//------------ game state ------------
@@ -297,6 +298,23 @@ int main(int argc, char **argv) {
 #define MAP 26
 #define HOLE 27
 
+//--- draw layers ---
+#define LAYER_BACKGROUND 0
+#define LAYER_OBJECTS 1
+#define LAYER_PLAYER 2
+#define LAYER_MESSAGE 3
+#define LAYER_OVERLAY 4
+
+//--- redraw pacing (ms to block waiting for input when nothing needs drawing) ---
+#define IDLE_WAIT_MS 500
+#define UNFOCUSED_WAIT_MS 1000
+#define HIDDEN_WAIT_MS 2000
+//minimum time between redraws while the window doesn't have focus:
+#define UNFOCUSED_FRAME_MS 100
+
+//--- asset loading (GL upload time to spend per frame on assets still loading) ---
+#define ASSET_UPLOAD_BUDGET_MS 2
+
 //--- player direction ---
 #define RIGHT 0
 #define UP 1
@@ -418,61 +436,121 @@ int main(int argc, char **argv) {
 	hole.can_interact = false;
 	
 	//--- sprites ---
-	static SpriteInfo background = load_sprite("center");
-	static SpriteInfo player_sp = load_sprite("player1");
-	static SpriteInfo board_sp = load_sprite("board");
-	static SpriteInfo rope_sp = load_sprite("rope");
-	static SpriteInfo pick_axe_head_sp = load_sprite("pickAxeHead");
-	static SpriteInfo stick_sp = load_sprite("stick");
-	static SpriteInfo rod_sp = load_sprite("rod");
-	static SpriteInfo knife_sp = load_sprite("knife");
-	static SpriteInfo bridge_sp = load_sprite("bridge");
-	static SpriteInfo pick_axe_sp = load_sprite("pickAxe");
-	static SpriteInfo long_knife_sp = load_sprite("longKnife");
-	static SpriteInfo crystal_sp = load_sprite("crystal");
-	static SpriteInfo coin_sp = load_sprite("coin");
-	static SpriteInfo apple_sp = load_sprite("apple");
-	static SpriteInfo rock_sp = load_sprite("rock");
-	static SpriteInfo key_sp = load_sprite("key");
-	static SpriteInfo gate_sp = load_sprite("gate");
-	static SpriteInfo hole_sp = load_sprite("hole");
-	static SpriteInfo scale_sp = load_sprite("scaleBalanced");
-	static SpriteInfo message_sp = load_sprite("message");
-	static SpriteInfo escaped_sp = load_sprite("escaped");
-	static SpriteInfo h_board_sp = load_sprite("h_board");
-	static SpriteInfo h_rope_sp = load_sprite("h_rope");
-	static SpriteInfo h_pick_axe_head_sp = load_sprite("h_pickAxeHead");
-	static SpriteInfo h_stick_sp = load_sprite("h_stick");
-	static SpriteInfo h_rod_sp = load_sprite("h_rod");
-	static SpriteInfo h_knife_sp = load_sprite("h_knife");
-	static SpriteInfo h_bridge_sp = load_sprite("h_bridge");
-	static SpriteInfo h_pick_axe_sp = load_sprite("h_pickAxe");
-	static SpriteInfo h_long_knife_sp = load_sprite("h_longKnife");
-	static SpriteInfo h_crystal_sp = load_sprite("h_crystal");
-	static SpriteInfo h_coin_sp = load_sprite("h_coin");
-	static SpriteInfo h_apple_sp = load_sprite("h_apple");
-	static SpriteInfo h_rock_sp = load_sprite("h_rock");
-	static SpriteInfo h_key_sp = load_sprite("h_key");
-	static SpriteInfo h_gate_sp = load_sprite("h_gate");
-	static SpriteInfo h_hole_sp = load_sprite("h_hole");
-	static SpriteInfo h_scale_sp = load_sprite("h_scaleBalanced");
-	static SpriteInfo h_bridgePlace_sp = load_sprite("h_bridgePlace");
-	static SpriteInfo h_work_bench_sp = load_sprite("h_workBench");
-	static SpriteInfo h_pillar_sp = load_sprite("h_pillar");
-	static SpriteInfo h_tree_sp = load_sprite("h_treeWithApple");
-	static SpriteInfo h_pond_sp = load_sprite("h_pond");
-	static SpriteInfo h_map_sp = load_sprite("h_map");
+	static SpriteInfo background = sprites["center"_sprite];
+	static SpriteInfo player_sp = sprites["player1"_sprite];
+	static SpriteInfo board_sp = sprites["board"_sprite];
+	static SpriteInfo rope_sp = sprites["rope"_sprite];
+	static SpriteInfo pick_axe_head_sp = sprites["pickAxeHead"_sprite];
+	static SpriteInfo stick_sp = sprites["stick"_sprite];
+	static SpriteInfo rod_sp = sprites["rod"_sprite];
+	static SpriteInfo knife_sp = sprites["knife"_sprite];
+	static SpriteInfo bridge_sp = sprites["bridge"_sprite];
+	static SpriteInfo pick_axe_sp = sprites["pickAxe"_sprite];
+	static SpriteInfo long_knife_sp = sprites["longKnife"_sprite];
+	static SpriteInfo crystal_sp = sprites["crystal"_sprite];
+	static SpriteInfo coin_sp = sprites["coin"_sprite];
+	static SpriteInfo apple_sp = sprites["apple"_sprite];
+	static SpriteInfo rock_sp = sprites["rock"_sprite];
+	static SpriteInfo key_sp = sprites["key"_sprite];
+	static SpriteInfo gate_sp = sprites["gate"_sprite];
+	static SpriteInfo hole_sp = sprites["hole"_sprite];
+	static SpriteInfo scale_sp = sprites["scaleBalanced"_sprite];
+	static SpriteInfo message_sp = sprites["message"_sprite];
+	static SpriteInfo escaped_sp = sprites["escaped"_sprite];
+	static SpriteInfo h_board_sp = sprites["h_board"_sprite];
+	static SpriteInfo h_rope_sp = sprites["h_rope"_sprite];
+	static SpriteInfo h_pick_axe_head_sp = sprites["h_pickAxeHead"_sprite];
+	static SpriteInfo h_stick_sp = sprites["h_stick"_sprite];
+	static SpriteInfo h_rod_sp = sprites["h_rod"_sprite];
+	static SpriteInfo h_knife_sp = sprites["h_knife"_sprite];
+	static SpriteInfo h_bridge_sp = sprites["h_bridge"_sprite];
+	static SpriteInfo h_pick_axe_sp = sprites["h_pickAxe"_sprite];
+	static SpriteInfo h_long_knife_sp = sprites["h_longKnife"_sprite];
+	static SpriteInfo h_crystal_sp = sprites["h_crystal"_sprite];
+	static SpriteInfo h_coin_sp = sprites["h_coin"_sprite];
+	static SpriteInfo h_apple_sp = sprites["h_apple"_sprite];
+	static SpriteInfo h_rock_sp = sprites["h_rock"_sprite];
+	static SpriteInfo h_key_sp = sprites["h_key"_sprite];
+	static SpriteInfo h_gate_sp = sprites["h_gate"_sprite];
+	static SpriteInfo h_hole_sp = sprites["h_hole"_sprite];
+	static SpriteInfo h_scale_sp = sprites["h_scaleBalanced"_sprite];
+	static SpriteInfo h_bridgePlace_sp = sprites["h_bridgePlace"_sprite];
+	static SpriteInfo h_work_bench_sp = sprites["h_workBench"_sprite];
+	static SpriteInfo h_pillar_sp = sprites["h_pillar"_sprite];
+	static SpriteInfo h_tree_sp = sprites["h_treeWithApple"_sprite];
+	static SpriteInfo h_pond_sp = sprites["h_pond"_sprite];
+	static SpriteInfo h_map_sp = sprites["h_map"_sprite];
 	
 	//==================================================================================================================
 	
+	//game state only changes in response to input, so frames are drawn on demand:
+	bool dirty = true;
+	Uint32 last_draw_ticks = 0;
+	//headless runs draw a fixed number of frames back-to-back:
+	uint32_t frames_drawn = 0;
+	auto headless_start = std::chrono::high_resolution_clock::now();
+
+	//edits to the texture or sprite table show up without restarting (except in headless runs):
+	std::unique_ptr< HotReload > hot_reload;
+	bool sprites_reloaded = false;
+	if (!headless) {
+		hot_reload.reset(new HotReload(loader, tex, sprites));
+		hot_reload->watch_texture("map.png");
+		hot_reload->watch_sprites("sprites.atlas");
+		hot_reload->watch_sprites("spriteBin.bin");
+		hot_reload->on_texture_reloaded = [&dirty](){
+			dirty = true;
+		};
+		hot_reload->on_sprites_reloaded = [&dirty,&sprites_reloaded,&batch](){
+			sprites_reloaded = true;
+			//the cached rooms hold the old texture coordinates:
+			batch.invalidate_cache(BACKGROUND_CENTER);
+			batch.invalidate_cache(BACKGROUND_LEFT);
+			batch.invalidate_cache(BACKGROUND_RIGHT);
+			dirty = true;
+		};
+	}
+
 	while (true) {
+		if (headless) {
+			if (frames_drawn == config.headless_frames) break;
+			dirty = true;
+		}
+		//the profiler overlay is only useful if frames keep coming (and footage should be continuous):
+		if (show_profiler || capturing) dirty = true;
+		//start reloading any asset files that were changed:
+		if (hot_reload) hot_reload->poll();
+		//finish off asset uploads, a budgeted amount per frame, redrawing until they're all in:
+		if (loader.busy()) {
+			loader.upload(ASSET_UPLOAD_BUDGET_MS * 0.001f);
+			dirty = true;
+		}
+
+		//block waiting for input unless a redraw is due; wait longer while hidden or unfocused:
+		Uint32 flags = (window ? SDL_GetWindowFlags(window) : SDL_WINDOW_INPUT_FOCUS);
+		bool hidden = (flags & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN)) != 0;
+		bool focused = (flags & SDL_WINDOW_INPUT_FOCUS) != 0;
+		int wait_ms = hidden ? HIDDEN_WAIT_MS : (focused ? IDLE_WAIT_MS : UNFOCUSED_WAIT_MS);
+
 		static SDL_Event evt;
-		while (SDL_PollEvent(&evt) == 1) {
+		int got = (dirty && !hidden) ? SDL_PollEvent(&evt) : SDL_WaitEventTimeout(&evt, wait_ms);
+		//(only handling is timed; time spent idle in the wait above isn't part of any phase)
+		profiler.begin(FrameProfiler::PhaseEvents);
+		for (; got == 1; got = SDL_PollEvent(&evt)) {
+			//anything other than mouse motion (which nothing reads yet) may change what is on screen:
+			if (evt.type == SDL_KEYDOWN || evt.type == SDL_WINDOWEVENT) {
+				dirty = true;
+			}
 			//handle input:
 			if (evt.type == SDL_MOUSEMOTION) {
 				mouse.x = (evt.motion.x + 0.5f) / float(config.size.x) * 2.0f - 1.0f;
 				mouse.y = (evt.motion.y + 0.5f) / float(config.size.y) *-2.0f + 1.0f;
 			} else if (evt.type == SDL_MOUSEBUTTONDOWN) {
+			} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F3) {
+				show_profiler = !show_profiler;
+			} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F12) {
+				capturing = !capturing;
+				std::cout << (capturing ? "Started" : "Stopped") << " capturing frames to '" << config.capture_prefix << "-*" << config.capture_extension << "'." << std::endl;
 			} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_ESCAPE) {
 				should_quit = true;
 			} else if (evt.type == SDL_QUIT) {
@@ -525,7 +603,19 @@ int main(int argc, char **argv) {
 				}
 			}
 		}
-		if (should_quit) break;
+		profiler.end(FrameProfiler::PhaseEvents);
+		if (should_quit || assets_failed) break;
+
+		//skip drawing when nothing changed (the last presented frame stays up) or nothing would be seen:
+		flags = (window ? SDL_GetWindowFlags(window) : SDL_WINDOW_INPUT_FOCUS);
+		if (!dirty || (flags & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN))) continue;
+		if (!(flags & SDL_WINDOW_INPUT_FOCUS)) {
+			Uint32 since = SDL_GetTicks() - last_draw_ticks;
+			if (since < UNFOCUSED_FRAME_MS) SDL_Delay(UNFOCUSED_FRAME_MS - since);
+		}
+		dirty = false;
+		last_draw_ticks = SDL_GetTicks();
+		profiler.begin_frame();
 		
 		auto current_time = std::chrono::high_resolution_clock::now();
 		static auto previous_time = current_time;
@@ -533,49 +623,38 @@ int main(int argc, char **argv) {
 		previous_time = current_time;
 
 		{ //update game state:
+			FrameProfiler::Scope scope(profiler, FrameProfiler::PhaseUpdate);
 			(void)elapsed;
 		}
 
-		//draw output:
-		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		//build the frame's sprites into 'batch' (the game's interactions are handled along the way);
+		//returns true if one of them changed what a room looks like:
+		auto build_frame = [&]() -> bool {
+			profiler.begin(FrameProfiler::PhaseBuild);
+			//sprites are sorted by layer when the batch is flushed; each section below sets the layer it draws into:
+			uint8_t layer = LAYER_BACKGROUND;
 
+			//helper: the current version of a sprite copied out of the table, which may have been reloaded since:
+			auto live = [&sprites,&sprites_reloaded](SpriteInfo const &sprite) -> SpriteInfo const & {
+				return (sprites_reloaded ? sprites.current(sprite) : sprite);
+			};
 
-		{ //draw game state:
-			std::vector< Vertex > verts;
-
-			//helper: add rectangle to verts:
-			auto rect = [&verts](glm::vec2 const &at, glm::vec2 const &rad, glm::vec2 const &uv_min, glm::vec2 const &uv_max, glm::u8vec4 const &tint) {
-				verts.emplace_back(at + glm::vec2(-rad.x,-rad.y), glm::vec2(uv_min.x, uv_min.y), tint);
-				verts.emplace_back(verts.back());
-				verts.emplace_back(at + glm::vec2(-rad.x, rad.y), glm::vec2(uv_min.x, uv_max.y), tint);
-				verts.emplace_back(at + glm::vec2( rad.x,-rad.y), glm::vec2(uv_max.x, uv_min.y), tint);
-				verts.emplace_back(at + glm::vec2( rad.x, rad.y), glm::vec2(uv_max.x, uv_max.y), tint);
-				verts.emplace_back(verts.back());
+			//helper: instance showing 'sprite' with radius 'rad'; sprites packed turned clockwise are turned back:
+			auto sprite_instance = [&live](SpriteInfo const &copy, glm::vec2 const &at, glm::vec2 const &rad, float angle, glm::u8vec4 const &tint) {
+				SpriteInfo const &sprite = live(copy);
+				if (sprite.rotated) {
+					return SpriteBatch::Instance(at, glm::vec2(rad.y, rad.x), sprite.min_uv, sprite.max_uv, tint, angle + 1.57079633f);
+				}
+				return SpriteBatch::Instance(at, rad, sprite.min_uv, sprite.max_uv, tint, angle);
 			};
 
-			auto draw_sprite = [&verts](SpriteInfo const &sprite, glm::vec2 const &at, float angle = 0.0f) {
-				glm::vec2 min_uv = sprite.min_uv;
-				glm::vec2 max_uv = sprite.max_uv;
-				glm::vec2 rad = sprite.rad;
-				glm::u8vec4 tint = glm::u8vec4(0xff, 0xff, 0xff, 0xff);
-				glm::vec2 right = glm::vec2(std::cos(angle), std::sin(angle));
-				glm::vec2 up = glm::vec2(-right.y, right.x);
-
-				verts.emplace_back(at + right * -rad.x + up * -rad.y, glm::vec2(min_uv.x, min_uv.y), tint);
-				verts.emplace_back(verts.back());
-				verts.emplace_back(at + right * -rad.x + up * rad.y, glm::vec2(min_uv.x, max_uv.y), tint);
-				verts.emplace_back(at + right *  rad.x + up * -rad.y, glm::vec2(max_uv.x, min_uv.y), tint);
-				verts.emplace_back(at + right *  rad.x + up *  rad.y, glm::vec2(max_uv.x, max_uv.y), tint);
-				verts.emplace_back(verts.back());
+			auto draw_sprite = [&batch,&tex,&layer,&live,&sprite_instance](SpriteInfo const &sprite, glm::vec2 const &at, float angle = 0.0f) {
+				batch.draw(sprite_instance(sprite, at, live(sprite).rad, angle, glm::u8vec4(0xff, 0xff, 0xff, 0xff)), tex, layer);
 			};
 				
 			
-			// background behavior in each map
+			//rooms change when walking off an edge:
 			if(current_map == BACKGROUND_CENTER) {
-				background = load_sprite("center");
 				if(P1.position.x>=12.2f && P1.direction==RIGHT) {
 					current_map = BACKGROUND_RIGHT;
 					P1.position.x = -12.2f;
@@ -584,19 +663,38 @@ int main(int argc, char **argv) {
 					P1.position.x = 12.2f;
 				}								
 			} else if (current_map == BACKGROUND_LEFT) {
-				background = load_sprite("left");
 				if(P1.position.x>=12.2f && P1.direction==RIGHT) {
 					current_map = BACKGROUND_CENTER;
 					P1.position.x = -12.2f;
 				}		
 			} else if (current_map == BACKGROUND_RIGHT) {
-				background = load_sprite("right");
 				if(P1.position.x<=-12.2f && P1.direction==LEFT) {
 					current_map = BACKGROUND_CENTER;
 					P1.position.x = 12.2f;
 				}		
 			}
-			rect(glm::vec2(0.0f, 0.0f), glm::vec2(camera.radius.x, camera.radius.y), background.min_uv, background.max_uv, glm::u8vec4(0xff, 0xff, 0xff, 0xff));
+
+			//the background and un-highlighted objects of each room are kept in a cache, re-recorded only after an interaction:
+			bool rebuild = !batch.cache_valid(current_map);
+			bool interacted = interact;
+			auto draw_static = [&batch,&tex,&layer,&rebuild,&current_map,&live,&sprite_instance](SpriteInfo const &sprite, glm::vec2 const &at, float angle = 0.0f) {
+				if (!rebuild) return;
+				batch.cache_draw(current_map, sprite_instance(sprite, at, live(sprite).rad, angle, glm::u8vec4(0xff, 0xff, 0xff, 0xff)), tex, layer);
+			};
+
+			// background in each map
+			if (rebuild) {
+				if(current_map == BACKGROUND_CENTER) {
+					background = sprites["center"_sprite];
+				} else if (current_map == BACKGROUND_LEFT) {
+					background = sprites["left"_sprite];
+				} else if (current_map == BACKGROUND_RIGHT) {
+					background = sprites["right"_sprite];
+				}
+				batch.cache_draw(current_map, sprite_instance(background, glm::vec2(0.0f, 0.0f), camera.radius, 0.0f, glm::u8vec4(0xff, 0xff, 0xff, 0xff)), tex, layer);
+			}
+			batch.draw_cache(current_map);
+			layer = LAYER_OBJECTS;
 			
 			// landmark behavior in each map
 			if(current_map == BACKGROUND_CENTER) {
@@ -672,7 +770,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(gate.show) {
-					draw_sprite(gate_sp, gate.position, 0.0f);
+					draw_static(gate_sp, gate.position, 0.0f);
 					if(gate.can_interact && gate.touches(P1)) {
 						draw_sprite(h_gate_sp, gate.position, 0.0f);
 						if(interact) {
@@ -1091,7 +1189,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(bridge.show && bridge.used) {
-					draw_sprite(bridge_sp, bridge.position, 0.0f);
+					draw_static(bridge_sp, bridge.position, 0.0f);
 				}
 				if(tree.can_interact && tree.touches(P1)) {
 					draw_sprite(h_tree_sp, tree.position, 0.0f);
@@ -1105,7 +1203,7 @@ int main(int argc, char **argv) {
 						long_knife.show = false;
 						long_knife.carried = false;
 						long_knife.can_interact = false;
-						h_tree_sp = load_sprite("h_tree");
+						h_tree_sp = sprites["h_tree"_sprite];
 					} else if(interact) {
 						interact = false;
 						show_message = TREE;
@@ -1113,7 +1211,7 @@ int main(int argc, char **argv) {
 				}
 			} else if (current_map == BACKGROUND_RIGHT) {
 				if(hole.show) {
-					draw_sprite(hole_sp, hole.position, 0.0f);
+					draw_static(hole_sp, hole.position, 0.0f);
 				}
 				if(hole.can_interact && hole.touches(P1)) {
 					draw_sprite(h_hole_sp, hole.position, 0.0f);
@@ -1142,7 +1240,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(scale.show) {
-					draw_sprite(scale_sp, scale.position, 0.0f);
+					draw_static(scale_sp, scale.position, 0.0f);
 					if(scale.can_interact && scale.touches(P1)) {
 						draw_sprite(h_scale_sp, scale.position, 0.0f);
 						if(interact) {
@@ -1156,7 +1254,7 @@ int main(int argc, char **argv) {
 			//movable behavior in each map
 			if (current_map == BACKGROUND_CENTER) {
 				if(board.show) {
-					draw_sprite(board_sp, board.position, 0.0f);
+					draw_static(board_sp, board.position, 0.0f);
 					if(board.can_interact && board.touches(P1)) {
 						draw_sprite(h_board_sp, board.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1170,7 +1268,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(pick_axe_head.show) {
-					draw_sprite(pick_axe_head_sp, pick_axe_head.position, 0.0f);
+					draw_static(pick_axe_head_sp, pick_axe_head.position, 0.0f);
 					if(pick_axe_head.can_interact && pick_axe_head.touches(P1)) {
 						draw_sprite(h_pick_axe_head_sp, pick_axe_head.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1184,7 +1282,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(bridge.show && !bridge.used) {
-					draw_sprite(bridge_sp, bridge.position, 0.0f);
+					draw_static(bridge_sp, bridge.position, 0.0f);
 					if(bridge.can_interact && bridge.touches(P1)) {
 						draw_sprite(h_bridge_sp, bridge.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1198,7 +1296,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(pick_axe.show) {
-					draw_sprite(pick_axe_sp, pick_axe.position, 0.0f);
+					draw_static(pick_axe_sp, pick_axe.position, 0.0f);
 					if(pick_axe.can_interact && pick_axe.touches(P1)) {
 						draw_sprite(h_pick_axe_sp, pick_axe.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1212,7 +1310,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(long_knife.show) {
-					draw_sprite(long_knife_sp, long_knife.position, 0.0f);
+					draw_static(long_knife_sp, long_knife.position, 0.0f);
 					if(long_knife.can_interact && long_knife.touches(P1)) {
 						draw_sprite(h_long_knife_sp, long_knife.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1226,7 +1324,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(key.show) {
-					draw_sprite(key_sp, key.position, 0.0f);
+					draw_static(key_sp, key.position, 0.0f);
 					if(key.can_interact && key.touches(P1)) {
 						draw_sprite(h_key_sp, key.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1240,7 +1338,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(crystal.show && crystal.used) {
-					draw_sprite(crystal_sp, crystal.position, 0.0f);
+					draw_static(crystal_sp, crystal.position, 0.0f);
 					if(crystal.can_interact && crystal.touches(P1)) {
 						draw_sprite(h_crystal_sp, crystal.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1254,7 +1352,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(apple.show && apple.used) {
-					draw_sprite(apple_sp, apple.position, 0.0f);
+					draw_static(apple_sp, apple.position, 0.0f);
 					if(apple.can_interact && apple.touches(P1)) {
 						draw_sprite(h_apple_sp, apple.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1268,7 +1366,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(coin.show && coin.used) {
-					draw_sprite(coin_sp, coin.position, 0.0f);
+					draw_static(coin_sp, coin.position, 0.0f);
 					if(coin.can_interact && coin.touches(P1)) {
 						draw_sprite(h_coin_sp, coin.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1282,7 +1380,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(rock.show && rock.used) {
-					draw_sprite(rock_sp, rock.position, 0.0f);
+					draw_static(rock_sp, rock.position, 0.0f);
 					if(rock.can_interact && rock.touches(P1)) {
 						draw_sprite(h_rock_sp, rock.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1297,7 +1395,7 @@ int main(int argc, char **argv) {
 				}
 			} else if (current_map == BACKGROUND_LEFT) {
 				if(stick.show) {
-					draw_sprite(stick_sp, stick.position, 0.0f);
+					draw_static(stick_sp, stick.position, 0.0f);
 					if(stick.can_interact && stick.touches(P1)) {
 						draw_sprite(h_stick_sp, stick.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1311,7 +1409,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(rope.show) {
-					draw_sprite(rope_sp, rope.position, 0.0f);
+					draw_static(rope_sp, rope.position, 0.0f);
 					if(rope.can_interact && rope.touches(P1)) {
 						draw_sprite(h_rope_sp, rope.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1325,7 +1423,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(crystal.show && !crystal.used) {
-					draw_sprite(crystal_sp, crystal.position, 0.0f);
+					draw_static(crystal_sp, crystal.position, 0.0f);
 					if(crystal.can_interact && crystal.touches(P1)) {
 						draw_sprite(h_crystal_sp, crystal.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1340,7 +1438,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(apple.show && !apple.used) {
-					draw_sprite(apple_sp, apple.position, 0.0f);
+					draw_static(apple_sp, apple.position, 0.0f);
 					if(apple.can_interact && apple.touches(P1)) {
 						draw_sprite(h_apple_sp, apple.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1357,7 +1455,7 @@ int main(int argc, char **argv) {
 				
 			} else if (current_map == BACKGROUND_RIGHT) {
 				if(rod.show) {
-					draw_sprite(rod_sp, rod.position, 0.0f);
+					draw_static(rod_sp, rod.position, 0.0f);
 					if(rod.can_interact && rod.touches(P1)) {
 						draw_sprite(h_rod_sp, rod.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1371,7 +1469,7 @@ int main(int argc, char **argv) {
 					}
 				}
 				if(knife.show) {
-					draw_sprite(knife_sp, knife.position, 0.0f);
+					draw_static(knife_sp, knife.position, 0.0f);
 					if(knife.can_interact && knife.touches(P1)) {
 						draw_sprite(h_knife_sp, knife.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1394,12 +1492,12 @@ int main(int argc, char **argv) {
 						rock.can_interact = false;
 						rock.carried = true;
 						rock.used = true;
-						scale_sp = load_sprite("scaleTilted");
-						h_scale_sp = load_sprite("h_scaleTilted");
+						scale_sp = sprites["scaleTilted"_sprite];
+						h_scale_sp = sprites["h_scaleTilted"_sprite];
 					}
 				}
 				if(coin.show && !coin.used) {
-					draw_sprite(coin_sp, coin.position, 0.0f);
+					draw_static(coin_sp, coin.position, 0.0f);
 					if(coin.can_interact && coin.touches(P1)) {
 						draw_sprite(h_coin_sp, coin.position, 0.0f);
 						if(interact && !P1.carrying) {
@@ -1415,50 +1513,55 @@ int main(int argc, char **argv) {
 				}
 			}
 			
+			//interactions above may have changed what any room looks like:
+			bool rooms_changed = (interacted && !interact);
+			
 			//determine the sprite of the player
+			layer = LAYER_PLAYER;
 			if(!escaped) {
 				if(P1.carrying==NONE) {
 					if(P1.walk_leg) {
-						player_sp = load_sprite("player1");
+						player_sp = sprites["player1"_sprite];
 					}
 					else {
-						player_sp = load_sprite("player2");
+						player_sp = sprites["player2"_sprite];
 					}
 				} else {
 					if(P1.walk_leg) {
-						player_sp = load_sprite("playerCarry1");
+						player_sp = sprites["playerCarry1"_sprite];
 					}
 					else {
-						player_sp = load_sprite("playerCarry2");
+						player_sp = sprites["playerCarry2"_sprite];
 					}
 				}
 				draw_sprite(player_sp, P1.position, 0.0f);
 			}
 			
 			
-			static SpriteInfo A = load_sprite("A");
-			static SpriteInfo C = load_sprite("C");
-			static SpriteInfo D = load_sprite("D");
-			static SpriteInfo E = load_sprite("E");
-			static SpriteInfo F = load_sprite("F");
-			static SpriteInfo G = load_sprite("G");
-			static SpriteInfo H = load_sprite("H");
-			static SpriteInfo I = load_sprite("I");
-			static SpriteInfo K = load_sprite("K");
-			static SpriteInfo L = load_sprite("L");
-			static SpriteInfo M = load_sprite("M");
-			static SpriteInfo N = load_sprite("N");
-			static SpriteInfo O = load_sprite("O");
-			static SpriteInfo P = load_sprite("P");
-			static SpriteInfo R = load_sprite("R");
-			static SpriteInfo S = load_sprite("S");
-			static SpriteInfo T = load_sprite("T");
-			static SpriteInfo U = load_sprite("U");
-			static SpriteInfo W = load_sprite("W");
-			static SpriteInfo Y = load_sprite("Y");
-			static SpriteInfo excl = load_sprite("exclamMark");
-			static SpriteInfo period = load_sprite("period");
+			static SpriteInfo A = sprites["A"_sprite];
+			static SpriteInfo C = sprites["C"_sprite];
+			static SpriteInfo D = sprites["D"_sprite];
+			static SpriteInfo E = sprites["E"_sprite];
+			static SpriteInfo F = sprites["F"_sprite];
+			static SpriteInfo G = sprites["G"_sprite];
+			static SpriteInfo H = sprites["H"_sprite];
+			static SpriteInfo I = sprites["I"_sprite];
+			static SpriteInfo K = sprites["K"_sprite];
+			static SpriteInfo L = sprites["L"_sprite];
+			static SpriteInfo M = sprites["M"_sprite];
+			static SpriteInfo N = sprites["N"_sprite];
+			static SpriteInfo O = sprites["O"_sprite];
+			static SpriteInfo P = sprites["P"_sprite];
+			static SpriteInfo R = sprites["R"_sprite];
+			static SpriteInfo S = sprites["S"_sprite];
+			static SpriteInfo T = sprites["T"_sprite];
+			static SpriteInfo U = sprites["U"_sprite];
+			static SpriteInfo W = sprites["W"_sprite];
+			static SpriteInfo Y = sprites["Y"_sprite];
+			static SpriteInfo excl = sprites["exclamMark"_sprite];
+			static SpriteInfo period = sprites["period"_sprite];
 			
+			layer = LAYER_MESSAGE;
 			switch(show_message) {
 				case WORK_BENCH: {
 					// MAKE STUFF HERE!
@@ -1571,15 +1674,94 @@ int main(int argc, char **argv) {
 				}
 			}
 
+			layer = LAYER_OVERLAY;
 			if(escaped) {
 				draw_sprite(escaped_sp, glm::vec2(0.0f, 0.0f), 0.0f);
 			}
+
+			if (show_profiler) {
+				//the atlas only has letters, so digits are drawn as look-alikes: 0-9 -> O I Z E A S G T B P
+				static SpriteInfo letters[26];
+				static bool letters_loaded = false;
+				if (!letters_loaded) {
+					for (int i = 0; i < 26; ++i) {
+						char name = char('A' + i);
+						letters[i] = sprites[sprite_hash(&name, 1)];
+					}
+					letters_loaded = true;
+				}
+				static SpriteInfo box_sp = sprites["message"_sprite];
+				char const *digit_letters = "OIZEASGTBP";
+				float const text_scale = 0.45f;
+				float const advance = 0.5f;
+
+				auto hud_rect = [&batch,&tex,&sprite_instance](glm::vec2 const &at, glm::vec2 const &rad, glm::u8vec4 const &tint) {
+					batch.draw(sprite_instance(box_sp, at, rad, 0.0f, tint), tex, LAYER_OVERLAY, BlendAlpha, 1);
+				};
+				//returns the x just past the text:
+				auto hud_text = [&](std::string const &text, glm::vec2 at) {
+					for (char c : text) {
+						SpriteInfo const *sp = nullptr;
+						if (c >= 'A' && c <= 'Z') sp = &letters[c - 'A'];
+						else if (c >= '0' && c <= '9') sp = &letters[digit_letters[c - '0'] - 'A'];
+						else if (c == '.') sp = &period;
+						if (sp) {
+							batch.draw(sprite_instance(*sp, at, live(*sp).rad * text_scale, 0.0f, glm::u8vec4(0xff, 0xff, 0xff, 0xff)), tex, LAYER_OVERLAY, BlendAlpha, 2);
+						}
+						at.x += (c == '.' ? 0.5f : 1.0f) * advance;
+					}
+					return at.x;
+				};
+				auto ms_text = [](float ms) {
+					char buf[16];
+					snprintf(buf, sizeof(buf), "%.2f", ms);
+					return std::string(buf);
+				};
+
+				glm::vec2 top_left = camera.at + glm::vec2(-camera.radius.x + 0.5f, camera.radius.y - 0.5f);
+				float const row = 0.6f;
+				uint32_t rows = FrameProfiler::PhaseCount + 1;
+				hud_rect(top_left + glm::vec2(6.0f, -0.5f * row * (rows - 1)), glm::vec2(6.5f, 0.5f * row * rows + 0.1f), glm::u8vec4(0x00, 0x00, 0x00, 0xa0));
+
+				//one row per phase: name, average cpu ms, then bars for cpu (orange) and gpu (blue) time at 1 unit per ms:
+				for (uint32_t p = 0; p < FrameProfiler::PhaseCount; ++p) {
+					FrameProfiler::Timing const &t = profiler.phase_timing[p];
+					glm::vec2 at = top_left + glm::vec2(0.0f, -row * p);
+					hud_text(FrameProfiler::phase_name(FrameProfiler::Phase(p)), at);
+					hud_text(ms_text(t.cpu_avg), at + glm::vec2(1.5f, 0.0f));
+					float bar_x = at.x + 4.5f;
+					float cpu_len = std::min(t.cpu_avg, 7.0f);
+					float gpu_len = std::min(t.gpu_avg, 7.0f);
+					hud_rect(glm::vec2(bar_x + 0.5f * cpu_len, at.y + 0.08f), glm::vec2(0.5f * cpu_len, 0.08f), glm::u8vec4(0xff, 0x99, 0x22, 0xff));
+					hud_rect(glm::vec2(bar_x + 0.5f * gpu_len, at.y - 0.1f), glm::vec2(0.5f * gpu_len, 0.06f), glm::u8vec4(0x33, 0x99, 0xff, 0xff));
+					//worst case tick:
+					float worst = std::min(t.cpu_worst, 7.0f);
+					hud_rect(glm::vec2(bar_x + worst, at.y), glm::vec2(0.04f, 0.2f), glm::u8vec4(0xff, 0x33, 0x33, 0xff));
+				}
+				{ //whole frame: average and worst:
+					glm::vec2 at = top_left + glm::vec2(0.0f, -row * FrameProfiler::PhaseCount);
+					hud_text("FR", at);
+					float x = hud_text(ms_text(profiler.frame_avg), at + glm::vec2(1.5f, 0.0f));
+					x = hud_text("WO", glm::vec2(x + advance, at.y));
+					hud_text(ms_text(profiler.frame_worst), glm::vec2(x + 0.5f * advance, at.y));
+				}
+			}
 //==================================================================================================================
-			glBindBuffer(GL_ARRAY_BUFFER, buffer);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * verts.size(), &verts[0], GL_STREAM_DRAW);
+			profiler.end(FrameProfiler::PhaseBuild);
+			return rooms_changed;
+		};
+
+		{ //draw game state:
+			if (build_frame()) {
+				//sprites queued before the interaction (and the cached room) show how things were, so build
+				//the frame again from the new state; only frames that match the game state are presented:
+				batch.discard();
+				batch.invalidate_cache(BACKGROUND_CENTER);
+				batch.invalidate_cache(BACKGROUND_LEFT);
+				batch.invalidate_cache(BACKGROUND_RIGHT);
+				build_frame();
+			}
 
-			glUseProgram(program);
-			glUniform1i(program_tex, 0);
 			glm::vec2 scale = 1.0f / camera.radius;
 			glm::vec2 offset = scale * -camera.at;
 			glm::mat4 mvp = glm::mat4(
@@ -1588,70 +1770,75 @@ int main(int argc, char **argv) {
 				glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
 				glm::vec4(offset.x, offset.y, 0.0f, 1.0f)
 			);
-			glUniformMatrix4fv(program_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
 
-			glBindTexture(GL_TEXTURE_2D, tex);
-			glBindVertexArray(vao);
+			{
+				FrameProfiler::Scope scope(profiler, FrameProfiler::PhaseUpload);
+				batch.upload(mvp);
+			}
 
-			glDrawArrays(GL_TRIANGLE_STRIP, 0, verts.size());
-		}
+			{ //draw output:
+				FrameProfiler::Scope scope(profiler, FrameProfiler::PhaseDraw);
+				glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+				glClear(GL_COLOR_BUFFER_BIT);
+				batch.submit();
+			}
 
+			if (capturing) { //queue a readback of the finished frame (before the swap discards it):
+				glm::uvec2 drawable_size = config.size;
+				if (headless) {
+					drawable_size = headless->size;
+				} else {
+					int w = 0, h = 0;
+					SDL_GL_GetDrawableSize(window, &w, &h);
+					drawable_size = glm::uvec2(w, h);
+				}
+				std::string number = std::to_string(capture_count);
+				number = std::string(number.size() < 5 ? 5 - number.size() : 0, '0') + number;
+				capture.capture(drawable_size, config.capture_prefix + "-" + number + config.capture_extension);
+				capture_count += 1;
+			}
+		}
 
-		SDL_GL_SwapWindow(window);
+		profiler.begin(FrameProfiler::PhaseSwap);
+		if (headless) {
+			glFinish();
+			frames_drawn += 1;
+		} else {
+			SDL_GL_SwapWindow(window);
+		}
+		profiler.end(FrameProfiler::PhaseSwap);
+		//hand captures whose readback has finished to the PNG writer:
+		capture.poll();
+		profiler.end_frame();
 	}
 
-
-	//------------  teardown ------------
-
-	SDL_GL_DeleteContext(context);
-	context = 0;
-
-	SDL_DestroyWindow(window);
-	window = NULL;
-
-	return 0;
-}
-
+	if (headless) {
+		float seconds = std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - headless_start).count();
+		std::cout << "Drew " << frames_drawn << " frames in " << seconds << "s (" << (1000.0f * seconds / frames_drawn) << " ms/frame)." << std::endl;
+		std::cout << "Last " << FrameProfiler::Window << " frames, ms (cpu avg / cpu worst / gpu avg):" << std::endl;
+		for (uint32_t p = 0; p < FrameProfiler::PhaseCount; ++p) {
+			FrameProfiler::Timing const &t = profiler.phase_timing[p];
+			std::cout << "  " << FrameProfiler::phase_name(FrameProfiler::Phase(p)) << " " << t.cpu_avg << " / " << t.cpu_worst << " / " << t.gpu_avg << std::endl;
+		}
+		if (config.headless_output != "") {
+			std::vector< uint32_t > data;
+			headless->read_pixels(&data);
+			std::string const &out = config.headless_output;
+			if (out.size() >= 4 && out.compare(out.size() - 4, 4, ".qoi") == 0) {
+				save_qoi(out, headless->size.x, headless->size.y, data.data(), LowerLeftOrigin);
+			} else {
+				save_png(out, headless->size.x, headless->size.y, data.data(), LowerLeftOrigin);
+			}
+			std::cout << "Wrote last frame to '" << config.headless_output << "'." << std::endl;
+		}
+	}
 
 
-static GLuint compile_shader(GLenum type, std::string const &source) {
-	GLuint shader = glCreateShader(type);
-	GLchar const *str = source.c_str();
-	GLint length = source.size();
-	glShaderSource(shader, 1, &str, &length);
-	glCompileShader(shader);
-	GLint compile_status = GL_FALSE;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-	if (compile_status != GL_TRUE) {
-		std::cerr << "Failed to compile shader." << std::endl;
-		GLint info_log_length = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_log_length);
-		std::vector< GLchar > info_log(info_log_length, 0);
-		GLsizei length = 0;
-		glGetShaderInfoLog(shader, info_log.size(), &length, &info_log[0]);
-		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		glDeleteShader(shader);
-		throw std::runtime_error("Failed to compile shader.");
+	if (capture_count) {
+		capture.finish();
+		save_png_flush();
+		std::cout << "Captured " << capture.captured << " frames to '" << config.capture_prefix << "-*" << config.capture_extension << "' (" << capture.stalls << " waited on readback, " << capture.writer_stalls << " on the writer)." << std::endl;
 	}
-	return shader;
-}
 
-static GLuint link_program(GLuint fragment_shader, GLuint vertex_shader) {
-	GLuint program = glCreateProgram();
-	glAttachShader(program, vertex_shader);
-	glAttachShader(program, fragment_shader);
-	glLinkProgram(program);
-	GLint link_status = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
-	if (link_status != GL_TRUE) {
-		std::cerr << "Failed to link shader program." << std::endl;
-		GLint info_log_length = 0;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
-		std::vector< GLchar > info_log(info_log_length, 0);
-		GLsizei length = 0;
-		glGetProgramInfoLog(program, info_log.size(), &length, &info_log[0]);
-		std::cerr << "Info log: " << std::string(info_log.begin(), info_log.begin() + length);
-		throw std::runtime_error("Failed to link program");
-	}
-	return program;
+	return assets_failed ? 1 : 0;
 }
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+
+#convert the old headerless spriteBin.bin (80 records of: char name[20]; float min_x, max_y, max_x, min_y in pixels)
+#into the self-describing format read by sprite_atlas.cpp, doing all the load-time fixups ahead of time.
+#usage: make-sprite-atlas.py [spriteBin.bin] [width] [height] [out.atlas]
+
+import struct
+import sys
+
+ATLAS_VERSION = 2
+
+src = sys.argv[1] if len(sys.argv) > 1 else 'dist/spriteBin.bin'
+width = int(sys.argv[2]) if len(sys.argv) > 2 else 481
+height = int(sys.argv[3]) if len(sys.argv) > 3 else 199
+dst = sys.argv[4] if len(sys.argv) > 4 else 'dist/sprites.atlas'
+
+def f32(x):
+	return struct.unpack('<f', struct.pack('<f', x))[0]
+
+def sprite_hash(name):
+	#FNV-1a, matching sprite_hash() in sprite_registry.hpp:
+	h = 2166136261
+	for b in name:
+		h = ((h ^ b) * 16777619) & 0xffffffff
+	return h
+
+data = open(src, 'rb').read()
+assert len(data) % 36 == 0, "expected 36-byte records"
+
+sprites = []
+screen_size = None
+for i in range(len(data) // 36):
+	name = data[i*36:i*36+20].split(b'\0')[0]
+	min_x, max_y, max_x, min_y = struct.unpack('<4f', data[i*36+20:i*36+36])
+	#flip to a lower-left origin:
+	min_y = f32(height - min_y)
+	max_y = f32(height - max_y)
+	#radius is scaled relative to the first sprite (the full-screen background):
+	if screen_size == None:
+		screen_size = (f32(max_x - min_x), f32(max_y - min_y))
+	rad = (f32(f32(13.3) * f32(f32(max_x - min_x) / screen_size[0])), f32(f32(9.975) * f32(f32(max_y - min_y) / screen_size[1])))
+	sprites.append((name, (f32(min_x / width), f32(min_y / height)), (f32(max_x / width), f32(max_y / height)), rad))
+
+strings = b''
+records = b''
+for (name, min_uv, max_uv, rad) in sprites:
+	records += struct.pack('<2I2H6f', sprite_hash(name), len(strings), len(name), 0, min_uv[0], min_uv[1], max_uv[0], max_uv[1], rad[0], rad[1])
+	strings += name
+
+header_size = 32
+records_offset = header_size
+strings_offset = records_offset + len(records)
+header = struct.pack('<4s7I', b'SPAT', ATLAS_VERSION, len(sprites), width, height, records_offset, strings_offset, len(strings))
+
+with open(dst, 'wb') as f:
+	f.write(header)
+	f.write(records)
+	f.write(strings)
+
+print("Wrote " + str(len(sprites)) + " sprites to '" + dst + "'.")
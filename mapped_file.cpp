@@ -0,0 +1,95 @@
+#include "mapped_file.hpp"
+
+#include <iostream>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+	if (mapping) munmap(mapping, mapping_size);
+#endif
+	mapping = nullptr;
+	mapping_size = 0;
+	storage.clear();
+	data = nullptr;
+	size = 0;
+}
+
+bool MappedFile::open(std::string const &filename) {
+	close();
+
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "Failed to open '" << filename << "'." << std::endl;
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		std::cerr << "Failed to stat '" << filename << "'." << std::endl;
+		::close(fd);
+		return false;
+	}
+	if (st.st_size < MAPPED_FILE_MIN_MAP_SIZE) {
+		//small (or empty, which can't be mapped) file; one read() is cheaper than setting up a mapping:
+		size_t file_size = size_t(st.st_size);
+		storage.resize((file_size + 3) / 4);
+		size_t got = 0;
+		while (got < file_size) {
+			ssize_t ret = ::read(fd, reinterpret_cast< char * >(storage.data()) + got, file_size - got);
+			if (ret < 0 && errno == EINTR) continue;
+			if (ret <= 0) break;
+			got += size_t(ret);
+		}
+		::close(fd);
+		if (got != file_size) {
+			std::cerr << "Failed to read '" << filename << "'." << std::endl;
+			close();
+			return false;
+		}
+		data = reinterpret_cast< char const * >(storage.data());
+		size = file_size;
+		return true;
+	}
+	void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (ptr == MAP_FAILED) {
+		std::cerr << "Failed to map '" << filename << "'." << std::endl;
+		return false;
+	}
+	mapping = ptr;
+	mapping_size = st.st_size;
+	data = reinterpret_cast< char const * >(ptr);
+	size = st.st_size;
+#else
+	//no mmap; read the whole file (into uint32_t storage, so contents stay aligned):
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to open '" << filename << "'." << std::endl;
+		return false;
+	}
+	file.seekg(0, std::ios::end);
+	size_t file_size = size_t(file.tellg());
+	file.seekg(0, std::ios::beg);
+	storage.resize((file_size + 3) / 4 + 1);
+	if (!file.read(reinterpret_cast< char * >(storage.data()), file_size)) {
+		std::cerr << "Failed to read '" << filename << "'." << std::endl;
+		close();
+		return false;
+	}
+	data = reinterpret_cast< char const * >(storage.data());
+	size = file_size;
+#endif
+	return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Read-only view of a whole file: memory-mapped where possible (so pages are only
+ * read from disk / the page cache as they are touched), otherwise read into memory.
+ * Files smaller than MAPPED_FILE_MIN_MAP_SIZE are always read, since for them the
+ * mmap/munmap calls and page faults cost more than the copy.
+ * Either way 'data' is at least 4-byte aligned (page-aligned when mapped).
+ */
+
+#define MAPPED_FILE_MIN_MAP_SIZE (64 * 1024)
+
+struct MappedFile {
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	//map (or read) 'filename'; returns false (with a message on stderr) on failure:
+	bool open(std::string const &filename);
+	void close();
+
+	char const *data = nullptr;
+	size_t size = 0;
+
+	//true if 'data' is a mapping of the file (rather than a copy):
+	bool mapped() const { return mapping != nullptr; }
+
+private:
+	//either a mapping of the file...
+	void *mapping = nullptr;
+	size_t mapping_size = 0;
+	//...or (where mmap isn't available) its contents:
+	std::vector< uint32_t > storage;
+};
@@ -0,0 +1,242 @@
+//pack_atlas: build a texture atlas (PNG) and its sprite table (.atlas, see sprite_atlas.hpp) from individual sprite PNGs.
+//usage: pack_atlas [--padding N] [--rotate] [--units-per-pixel F] [--max-size N] out.png out.atlas sprite.png [sprite.png ...]
+//Each sprite is named after its file (without directory or extension).
+
+#include "atlas_packer.hpp"
+#include "sprite_atlas.hpp"
+#include "load_save_png.hpp"
+#include "load_save_qoi.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct InputSprite {
+	std::string filename;
+	std::string name;
+	glm::uvec2 size = glm::uvec2(0,0);
+	std::vector< uint32_t > data; //lower-left origin
+	bool loaded = false;
+	//placement (of the padded rectangle) in the atlas:
+	glm::uvec2 at = glm::uvec2(0,0);
+	bool rotated = false;
+};
+
+static std::string sprite_name_from(std::string const &filename) {
+	size_t begin = filename.find_last_of("/\\");
+	begin = (begin == std::string::npos ? 0 : begin + 1);
+	size_t end = filename.find_last_of('.');
+	if (end == std::string::npos || end < begin) end = filename.size();
+	return filename.substr(begin, end - begin);
+}
+
+//try to pack everything into 'size'; fills in placements on success:
+static bool pack_into(glm::uvec2 const &size, bool allow_rotation, uint32_t padding, std::vector< InputSprite * > const &order, glm::uvec2 *used) {
+	MaxRectsPacker packer(size, allow_rotation);
+	for (auto sprite : order) {
+		glm::uvec2 padded = sprite->size + glm::uvec2(2 * padding);
+		if (!packer.insert(padded, &sprite->at, &sprite->rotated)) return false;
+	}
+	*used = packer.used;
+	return true;
+}
+
+int main(int argc, char **argv) {
+	uint32_t padding = 1;
+	bool allow_rotation = false;
+	//world units per pixel; matches the original hand-made atlas (160-pixel-wide screens, 13.3 unit radius):
+	float units_per_pixel = 26.6f / 160.0f;
+	uint32_t max_size = 4096;
+	std::vector< std::string > args;
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--padding" && argi + 1 < argc) {
+			padding = std::max(0, atoi(argv[++argi]));
+		} else if (arg == "--rotate") {
+			allow_rotation = true;
+		} else if (arg == "--units-per-pixel" && argi + 1 < argc) {
+			units_per_pixel = float(atof(argv[++argi]));
+		} else if (arg == "--max-size" && argi + 1 < argc) {
+			max_size = std::max(1, atoi(argv[++argi]));
+		} else {
+			args.emplace_back(arg);
+		}
+	}
+	if (args.size() < 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--padding N] [--rotate] [--units-per-pixel F] [--max-size N] out.png out.atlas sprite.png [sprite.png ...]" << std::endl;
+		return 1;
+	}
+	std::string out_png = args[0];
+	std::string out_atlas = args[1];
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector< InputSprite > sprites(args.size() - 2);
+	for (uint32_t i = 0; i < sprites.size(); ++i) {
+		sprites[i].filename = args[i + 2];
+		sprites[i].name = sprite_name_from(sprites[i].filename);
+		if (sprites[i].name.size() > 0xffff) {
+			std::cerr << "Sprite name from '" << sprites[i].filename << "' is too long." << std::endl;
+			return 1;
+		}
+	}
+
+	{ //decode inputs in parallel; workers pull the next unclaimed file:
+		std::atomic< uint32_t > next(0);
+		auto work = [&]() {
+			for (uint32_t i = next++; i < sprites.size(); i = next++) {
+				InputSprite &sprite = sprites[i];
+				sprite.loaded = load_image(sprite.filename, &sprite.size.x, &sprite.size.y, &sprite.data, LowerLeftOrigin);
+			}
+		};
+		uint32_t thread_count = std::max(1u, std::min(std::thread::hardware_concurrency(), uint32_t(sprites.size())));
+		std::vector< std::thread > threads;
+		for (uint32_t t = 1; t < thread_count; ++t) {
+			threads.emplace_back(work);
+		}
+		work();
+		for (auto &thread : threads) {
+			thread.join();
+		}
+	}
+	for (auto const &sprite : sprites) {
+		if (!sprite.loaded) {
+			std::cerr << "Failed to load '" << sprite.filename << "'." << std::endl;
+			return 1;
+		}
+	}
+
+	//names must be unique (by hash, too, since that's how the game looks them up):
+	for (uint32_t i = 0; i < sprites.size(); ++i) {
+		for (uint32_t j = 0; j < i; ++j) {
+			if (sprite_hash(sprites[i].name.c_str(), sprites[i].name.size()) == sprite_hash(sprites[j].name.c_str(), sprites[j].name.size())) {
+				std::cerr << "Sprites '" << sprites[j].filename << "' and '" << sprites[i].filename << "' have the same name (or name hash)." << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	//pack big things first; they are the hardest to place:
+	std::vector< InputSprite * > order;
+	uint64_t area = 0;
+	for (auto &sprite : sprites) {
+		order.emplace_back(&sprite);
+		area += uint64_t(sprite.size.x + 2 * padding) * uint64_t(sprite.size.y + 2 * padding);
+	}
+	std::stable_sort(order.begin(), order.end(), [](InputSprite const *a, InputSprite const *b) {
+		uint32_t a_max = std::max(a->size.x, a->size.y);
+		uint32_t b_max = std::max(b->size.x, b->size.y);
+		if (a_max != b_max) return a_max > b_max;
+		return a->size.x * a->size.y > b->size.x * b->size.y;
+	});
+
+	//try a range of bin widths (each with room to grow down) and keep whichever packing has the smallest extent:
+	uint32_t min_width = 1;
+	for (auto sprite : order) {
+		glm::uvec2 padded = sprite->size + glm::uvec2(2 * padding);
+		min_width = std::max(min_width, allow_rotation ? std::min(padded.x, padded.y) : padded.x);
+	}
+	uint32_t max_width = std::min(max_size, std::max(min_width, 2 * uint32_t(std::ceil(std::sqrt(double(area))))));
+	uint32_t step = std::max(1u, (max_width - min_width) / 32);
+	glm::uvec2 used = glm::uvec2(0,0);
+	uint32_t best_width = 0;
+	for (uint32_t width = min_width; width <= max_width; width += step) {
+		glm::uvec2 extent;
+		if (!pack_into(glm::uvec2(width, max_size), allow_rotation, padding, order, &extent)) continue;
+		if (best_width == 0 || uint64_t(extent.x) * extent.y < uint64_t(used.x) * used.y) {
+			used = extent;
+			best_width = width;
+		}
+	}
+	if (best_width == 0) {
+		std::cerr << "Sprites don't fit in a " << max_size << "x" << max_size << " atlas." << std::endl;
+		return 1;
+	}
+	//re-run the winner to restore its placements:
+	pack_into(glm::uvec2(best_width, max_size), allow_rotation, padding, order, &used);
+
+	//copy pixels (rotated sprites are stored turned clockwise), extruding edges into the padding:
+	std::vector< uint32_t > atlas(used.x * used.y, 0);
+	for (auto const &sprite : sprites) {
+		glm::uvec2 stored = (sprite.rotated ? glm::uvec2(sprite.size.y, sprite.size.x) : sprite.size);
+		for (int32_t y = -int32_t(padding); y < int32_t(stored.y + padding); ++y) {
+			for (int32_t x = -int32_t(padding); x < int32_t(stored.x + padding); ++x) {
+				uint32_t u = uint32_t(std::min(std::max(x, 0), int32_t(stored.x) - 1));
+				uint32_t v = uint32_t(std::min(std::max(y, 0), int32_t(stored.y) - 1));
+				//stored(u,v) = source(w-1-v, u) when rotated:
+				uint32_t sx = (sprite.rotated ? sprite.size.x - 1 - v : u);
+				uint32_t sy = (sprite.rotated ? u : v);
+				uint32_t ax = sprite.at.x + padding + x;
+				uint32_t ay = sprite.at.y + padding + y;
+				atlas[ay * used.x + ax] = sprite.data[sy * sprite.size.x + sx];
+			}
+		}
+	}
+	PngSaveOptions png_options;
+	png_options.threads = 0; //(deflate on every core)
+	if (!save_png(out_png, used.x, used.y, atlas.data(), LowerLeftOrigin, png_options)) {
+		std::cerr << "Failed to write '" << out_png << "'." << std::endl;
+		return 1;
+	}
+
+	{ //sprite table:
+		AtlasHeader header;
+		memcpy(header.magic, "SPAT", 4);
+		header.version = ATLAS_VERSION;
+		header.sprite_count = sprites.size();
+		header.width = used.x;
+		header.height = used.y;
+		header.records_offset = sizeof(AtlasHeader);
+		header.strings_offset = header.records_offset + sprites.size() * sizeof(AtlasRecord);
+
+		std::vector< AtlasRecord > records;
+		std::string strings;
+		for (auto const &sprite : sprites) {
+			glm::uvec2 stored = (sprite.rotated ? glm::uvec2(sprite.size.y, sprite.size.x) : sprite.size);
+			glm::uvec2 min = sprite.at + glm::uvec2(padding);
+			glm::uvec2 max = min + stored;
+			AtlasRecord record;
+			record.name_hash = sprite_hash(sprite.name.c_str(), sprite.name.size());
+			record.name_offset = strings.size();
+			record.name_length = uint16_t(sprite.name.size());
+			record.flags = (sprite.rotated ? AtlasRotated : 0);
+			record.min_uv[0] = min.x / float(used.x);
+			record.min_uv[1] = min.y / float(used.y);
+			record.max_uv[0] = max.x / float(used.x);
+			record.max_uv[1] = max.y / float(used.y);
+			//radius is of the sprite as drawn, i.e. un-rotated:
+			record.rad[0] = 0.5f * sprite.size.x * units_per_pixel;
+			record.rad[1] = 0.5f * sprite.size.y * units_per_pixel;
+			records.emplace_back(record);
+			strings += sprite.name;
+		}
+		header.strings_size = strings.size();
+
+		std::ofstream out(out_atlas, std::ios::binary);
+		out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		out.write(reinterpret_cast< char const * >(records.data()), records.size() * sizeof(AtlasRecord));
+		out.write(strings.data(), strings.size());
+		if (!out) {
+			std::cerr << "Failed to write '" << out_atlas << "'." << std::endl;
+			return 1;
+		}
+	}
+
+	float seconds = std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - start).count();
+	uint64_t used_area = 0;
+	for (auto const &sprite : sprites) used_area += uint64_t(sprite.size.x) * sprite.size.y;
+	std::cout << "Packed " << sprites.size() << " sprites into " << used.x << "x" << used.y
+		<< " (" << int(100.0 * double(used_area) / double(used.x * used.y)) << "% used) in " << seconds << "s." << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,389 @@
+#include "pixel_convert.hpp"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_CONVERT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//SSSE3 and AVX2 kernels are compiled with per-function target attributes and picked at runtime,
+//which needs GCC or clang; other compilers stop at SSE2:
+#if defined(PIXEL_CONVERT_SSE2) && defined(__GNUC__)
+#define PIXEL_CONVERT_TARGETS 1
+#include <immintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+//---------------- scalar ----------------
+//(written byte-wise, so they don't depend on endianness)
+
+static void rgb_to_rgba_scalar(uint8_t const *src, uint32_t *dst_, size_t count) {
+	uint8_t *dst = reinterpret_cast< uint8_t * >(dst_);
+	for (size_t i = 0; i < count; ++i) {
+		dst[4*i+0] = src[3*i+0];
+		dst[4*i+1] = src[3*i+1];
+		dst[4*i+2] = src[3*i+2];
+		dst[4*i+3] = 0xff;
+	}
+}
+
+static void gray_to_rgba_scalar(uint8_t const *src, uint32_t *dst_, size_t count) {
+	uint8_t *dst = reinterpret_cast< uint8_t * >(dst_);
+	for (size_t i = 0; i < count; ++i) {
+		dst[4*i+0] = dst[4*i+1] = dst[4*i+2] = src[i];
+		dst[4*i+3] = 0xff;
+	}
+}
+
+static void gray_alpha_to_rgba_scalar(uint8_t const *src, uint32_t *dst_, size_t count) {
+	uint8_t *dst = reinterpret_cast< uint8_t * >(dst_);
+	for (size_t i = 0; i < count; ++i) {
+		dst[4*i+0] = dst[4*i+1] = dst[4*i+2] = src[2*i+0];
+		dst[4*i+3] = src[2*i+1];
+	}
+}
+
+static void strip_16_scalar(uint8_t const *src, uint8_t *dst, size_t samples) {
+	for (size_t i = 0; i < samples; ++i) {
+		dst[i] = src[2*i];
+	}
+}
+
+//c * a / 255, rounded to nearest:
+static inline uint8_t mul_255(uint32_t c, uint32_t a) {
+	uint32_t t = c * a + 128;
+	return uint8_t((t + (t >> 8)) >> 8);
+}
+
+static void premultiply_scalar(uint32_t *pixels_, size_t count) {
+	uint8_t *pixels = reinterpret_cast< uint8_t * >(pixels_);
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t a = pixels[4*i+3];
+		pixels[4*i+0] = mul_255(pixels[4*i+0], a);
+		pixels[4*i+1] = mul_255(pixels[4*i+1], a);
+		pixels[4*i+2] = mul_255(pixels[4*i+2], a);
+	}
+}
+
+static void swizzle_bgra_scalar(uint32_t *pixels_, size_t count) {
+	uint8_t *pixels = reinterpret_cast< uint8_t * >(pixels_);
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t r = pixels[4*i+0];
+		pixels[4*i+0] = pixels[4*i+2];
+		pixels[4*i+2] = r;
+	}
+}
+
+//---------------- SSE2 ----------------
+
+#ifdef PIXEL_CONVERT_SSE2
+
+static void gray_to_rgba_sse2(uint8_t const *src, uint32_t *dst, size_t count) {
+	__m128i const alpha = _mm_set1_epi32(int(0xff000000));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i g = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + i));
+		__m128i gg_lo = _mm_unpacklo_epi8(g, g);
+		__m128i gg_hi = _mm_unpackhi_epi8(g, g);
+		__m128i *out = reinterpret_cast< __m128i * >(dst + i);
+		_mm_storeu_si128(out + 0, _mm_or_si128(_mm_unpacklo_epi16(gg_lo, gg_lo), alpha));
+		_mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(gg_lo, gg_lo), alpha));
+		_mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(gg_hi, gg_hi), alpha));
+		_mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(gg_hi, gg_hi), alpha));
+	}
+	gray_to_rgba_scalar(src + i, dst + i, count - i);
+}
+
+//(0x0000AAGG in each 32-bit lane) -> 0xAAGGGGGG:
+static inline __m128i expand_gray_alpha_sse2(__m128i ga) {
+	__m128i g = _mm_and_si128(ga, _mm_set1_epi32(0xff));
+	__m128i a = _mm_slli_epi32(_mm_srli_epi32(ga, 8), 24);
+	return _mm_or_si128(_mm_or_si128(g, a), _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(g, 16)));
+}
+
+static void gray_alpha_to_rgba_sse2(uint8_t const *src, uint32_t *dst, size_t count) {
+	__m128i const zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i ga = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + 2*i));
+		__m128i *out = reinterpret_cast< __m128i * >(dst + i);
+		_mm_storeu_si128(out + 0, expand_gray_alpha_sse2(_mm_unpacklo_epi16(ga, zero)));
+		_mm_storeu_si128(out + 1, expand_gray_alpha_sse2(_mm_unpackhi_epi16(ga, zero)));
+	}
+	gray_alpha_to_rgba_scalar(src + 2*i, dst + i, count - i);
+}
+
+static void strip_16_sse2(uint8_t const *src, uint8_t *dst, size_t samples) {
+	//(big-endian samples, so the high byte is the low byte of each little-endian 16-bit lane)
+	__m128i const low = _mm_set1_epi16(0xff);
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + 2*i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + 2*i + 16));
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(dst + i), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+	}
+	strip_16_scalar(src + 2*i, dst + i, samples - i);
+}
+
+//16-bit lanes R,G,B,A,R,G,B,A -> each times A/255 (A times 255/255), rounded:
+static inline __m128i premultiply_lanes_sse2(__m128i x) {
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+	__m128i mul = _mm_or_si128(_mm_and_si128(a, _mm_set_epi16(0,-1,-1,-1,0,-1,-1,-1)), _mm_set_epi16(255,0,0,0,255,0,0,0));
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(x, mul), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void premultiply_sse2(uint32_t *pixels, size_t count) {
+	__m128i const zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i *at = reinterpret_cast< __m128i * >(pixels + i);
+		__m128i p = _mm_loadu_si128(at);
+		__m128i lo = premultiply_lanes_sse2(_mm_unpacklo_epi8(p, zero));
+		__m128i hi = premultiply_lanes_sse2(_mm_unpackhi_epi8(p, zero));
+		_mm_storeu_si128(at, _mm_packus_epi16(lo, hi));
+	}
+	premultiply_scalar(pixels + i, count - i);
+}
+
+static void swizzle_bgra_sse2(uint32_t *pixels, size_t count) {
+	__m128i const ag_mask = _mm_set1_epi32(int(0xff00ff00));
+	__m128i const rb_mask = _mm_set1_epi32(0x00ff00ff);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i *at = reinterpret_cast< __m128i * >(pixels + i);
+		__m128i p = _mm_loadu_si128(at);
+		__m128i rb = _mm_and_si128(p, rb_mask);
+		rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+		_mm_storeu_si128(at, _mm_or_si128(_mm_and_si128(p, ag_mask), rb));
+	}
+	swizzle_bgra_scalar(pixels + i, count - i);
+}
+
+#endif //PIXEL_CONVERT_SSE2
+
+//---------------- SSSE3 / AVX2 ----------------
+
+#ifdef PIXEL_CONVERT_TARGETS
+
+TARGET_SSSE3 static void rgb_to_rgba_ssse3(uint8_t const *src, uint32_t *dst, size_t count) {
+	__m128i const spread = _mm_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+	__m128i const alpha = _mm_set1_epi32(int(0xff000000));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		//16 pixels are 48 bytes; each output register takes 12 of them:
+		__m128i const *in = reinterpret_cast< __m128i const * >(src + 3*i);
+		__m128i a = _mm_loadu_si128(in + 0);
+		__m128i b = _mm_loadu_si128(in + 1);
+		__m128i c = _mm_loadu_si128(in + 2);
+		__m128i *out = reinterpret_cast< __m128i * >(dst + i);
+		_mm_storeu_si128(out + 0, _mm_or_si128(_mm_shuffle_epi8(a, spread), alpha));
+		_mm_storeu_si128(out + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), spread), alpha));
+		_mm_storeu_si128(out + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), spread), alpha));
+		_mm_storeu_si128(out + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), spread), alpha));
+	}
+	rgb_to_rgba_scalar(src + 3*i, dst + i, count - i);
+}
+
+TARGET_AVX2 static void rgb_to_rgba_avx2(uint8_t const *src, uint32_t *dst, size_t count) {
+	__m256i const spread = _mm256_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1, 0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+	__m256i const alpha = _mm256_set1_epi32(int(0xff000000));
+	size_t i = 0;
+	//8 pixels per step, 4 from each 16-byte load (the second load reads 4 bytes past the 24 used, hence 'i + 10'):
+	for (; i + 10 <= count; i += 8) {
+		__m128i lo = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + 3*i));
+		__m128i hi = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + 3*i + 12));
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(dst + i), _mm256_or_si256(_mm256_shuffle_epi8(v, spread), alpha));
+	}
+	rgb_to_rgba_scalar(src + 3*i, dst + i, count - i);
+}
+
+TARGET_AVX2 static void gray_to_rgba_avx2(uint8_t const *src, uint32_t *dst, size_t count) {
+	__m256i const spread_a = _mm256_setr_epi8(0,0,0,-1, 1,1,1,-1, 2,2,2,-1, 3,3,3,-1, 4,4,4,-1, 5,5,5,-1, 6,6,6,-1, 7,7,7,-1);
+	__m256i const spread_b = _mm256_setr_epi8(8,8,8,-1, 9,9,9,-1, 10,10,10,-1, 11,11,11,-1, 12,12,12,-1, 13,13,13,-1, 14,14,14,-1, 15,15,15,-1);
+	__m256i const alpha = _mm256_set1_epi32(int(0xff000000));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		//both lanes get all 16 gray bytes; each shuffle spreads four of them per lane:
+		__m256i g = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast< __m128i const * >(src + i)));
+		__m256i *out = reinterpret_cast< __m256i * >(dst + i);
+		_mm256_storeu_si256(out + 0, _mm256_or_si256(_mm256_shuffle_epi8(g, spread_a), alpha));
+		_mm256_storeu_si256(out + 1, _mm256_or_si256(_mm256_shuffle_epi8(g, spread_b), alpha));
+	}
+	gray_to_rgba_scalar(src + i, dst + i, count - i);
+}
+
+TARGET_AVX2 static void gray_alpha_to_rgba_avx2(uint8_t const *src, uint32_t *dst, size_t count) {
+	__m256i const spread = _mm256_setr_epi8(0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7, 0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i ga = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + 2*i));
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(ga), _mm_srli_si128(ga, 8), 1);
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(dst + i), _mm256_shuffle_epi8(v, spread));
+	}
+	gray_alpha_to_rgba_scalar(src + 2*i, dst + i, count - i);
+}
+
+TARGET_AVX2 static void strip_16_avx2(uint8_t const *src, uint8_t *dst, size_t samples) {
+	__m256i const low = _mm256_set1_epi16(0xff);
+	size_t i = 0;
+	for (; i + 32 <= samples; i += 32) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(src + 2*i));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(src + 2*i + 32));
+		__m256i packed = _mm256_packus_epi16(_mm256_and_si256(a, low), _mm256_and_si256(b, low));
+		//(packus works per 128-bit lane, so put the quarters back in order)
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(dst + i), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3,1,2,0)));
+	}
+	strip_16_sse2(src + 2*i, dst + i, samples - i);
+}
+
+TARGET_AVX2 static inline __m256i premultiply_lanes_avx2(__m256i x) {
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+	__m256i mul = _mm256_blend_epi16(a, _mm256_set1_epi16(255), 0x88);
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(x, mul), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+TARGET_AVX2 static void premultiply_avx2(uint32_t *pixels, size_t count) {
+	__m256i const zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i *at = reinterpret_cast< __m256i * >(pixels + i);
+		__m256i p = _mm256_loadu_si256(at);
+		//(unpack and pack are both per-lane, so the pixel order survives)
+		__m256i lo = premultiply_lanes_avx2(_mm256_unpacklo_epi8(p, zero));
+		__m256i hi = premultiply_lanes_avx2(_mm256_unpackhi_epi8(p, zero));
+		_mm256_storeu_si256(at, _mm256_packus_epi16(lo, hi));
+	}
+	premultiply_sse2(pixels + i, count - i);
+}
+
+TARGET_AVX2 static void swizzle_bgra_avx2(uint32_t *pixels, size_t count) {
+	__m256i const swap = _mm256_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15, 2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i *at = reinterpret_cast< __m256i * >(pixels + i);
+		_mm256_storeu_si256(at, _mm256_shuffle_epi8(_mm256_loadu_si256(at), swap));
+	}
+	swizzle_bgra_sse2(pixels + i, count - i);
+}
+
+#endif //PIXEL_CONVERT_TARGETS
+
+//---------------- dispatch ----------------
+
+namespace {
+struct Kernels {
+	char const *name;
+	void (*rgb_to_rgba)(uint8_t const *, uint32_t *, size_t);
+	void (*gray_to_rgba)(uint8_t const *, uint32_t *, size_t);
+	void (*gray_alpha_to_rgba)(uint8_t const *, uint32_t *, size_t);
+	void (*strip_16)(uint8_t const *, uint8_t *, size_t);
+	void (*premultiply)(uint32_t *, size_t);
+	void (*swizzle_bgra)(uint32_t *, size_t);
+};
+
+Kernels const scalar_kernels = {
+	"scalar", rgb_to_rgba_scalar, gray_to_rgba_scalar, gray_alpha_to_rgba_scalar, strip_16_scalar, premultiply_scalar, swizzle_bgra_scalar
+};
+#ifdef PIXEL_CONVERT_SSE2
+Kernels const sse2_kernels = {
+	"sse2", rgb_to_rgba_scalar, gray_to_rgba_sse2, gray_alpha_to_rgba_sse2, strip_16_sse2, premultiply_sse2, swizzle_bgra_sse2
+};
+#endif
+#ifdef PIXEL_CONVERT_TARGETS
+Kernels const ssse3_kernels = {
+	"ssse3", rgb_to_rgba_ssse3, gray_to_rgba_sse2, gray_alpha_to_rgba_sse2, strip_16_sse2, premultiply_sse2, swizzle_bgra_sse2
+};
+Kernels const avx2_kernels = {
+	"avx2", rgb_to_rgba_avx2, gray_to_rgba_avx2, gray_alpha_to_rgba_avx2, strip_16_avx2, premultiply_avx2, swizzle_bgra_avx2
+};
+#endif
+
+Kernels const *find_kernels(char const *isa) {
+	if (strcmp(isa, "scalar") == 0) return &scalar_kernels;
+#ifdef PIXEL_CONVERT_SSE2
+	if (strcmp(isa, "sse2") == 0) return &sse2_kernels;
+#endif
+#ifdef PIXEL_CONVERT_TARGETS
+	if (strcmp(isa, "ssse3") == 0 && __builtin_cpu_supports("ssse3")) return &ssse3_kernels;
+	if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) return &avx2_kernels;
+#endif
+	return nullptr;
+}
+
+Kernels const *best_kernels() {
+	char const *preferred[] = {"avx2", "ssse3", "sse2"};
+	for (char const *isa : preferred) {
+		if (Kernels const *found = find_kernels(isa)) return found;
+	}
+	return &scalar_kernels;
+}
+
+std::atomic< Kernels const * > &kernels() {
+	static std::atomic< Kernels const * > current(best_kernels());
+	return current;
+}
+}
+
+void convert_rgb_to_rgba(uint8_t const *src, uint32_t *dst, size_t count) {
+	kernels().load(std::memory_order_relaxed)->rgb_to_rgba(src, dst, count);
+}
+
+void convert_gray_to_rgba(uint8_t const *src, uint32_t *dst, size_t count) {
+	kernels().load(std::memory_order_relaxed)->gray_to_rgba(src, dst, count);
+}
+
+void convert_gray_alpha_to_rgba(uint8_t const *src, uint32_t *dst, size_t count) {
+	kernels().load(std::memory_order_relaxed)->gray_alpha_to_rgba(src, dst, count);
+}
+
+void convert_strip_16(uint8_t const *src, uint8_t *dst, size_t samples) {
+	kernels().load(std::memory_order_relaxed)->strip_16(src, dst, samples);
+}
+
+void convert_premultiply(uint32_t *pixels, size_t count) {
+	kernels().load(std::memory_order_relaxed)->premultiply(pixels, count);
+}
+
+void convert_swizzle_bgra(uint32_t *pixels, size_t count) {
+	kernels().load(std::memory_order_relaxed)->swizzle_bgra(pixels, count);
+}
+
+void convert_palette_to_rgba(uint8_t const *src, uint32_t *dst, size_t count, uint32_t const *palette) {
+	//(a table lookup per pixel; gathers are no faster than this)
+	for (size_t i = 0; i < count; ++i) {
+		dst[i] = palette[src[i]];
+	}
+}
+
+void convert_palette_to_rgb(uint8_t const *src, uint8_t *dst, size_t count, uint32_t const *palette) {
+	for (size_t i = 0; i < count; ++i) {
+		memcpy(dst + 3 * i, &palette[src[i]], 3);
+	}
+}
+
+void convert_unpack_bits(uint8_t const *src, uint8_t *dst, size_t count, unsigned int bit_depth, bool scale) {
+	unsigned int per_byte = 8 / bit_depth;
+	uint8_t mask = uint8_t((1u << bit_depth) - 1);
+	uint8_t factor = (scale ? uint8_t(255 / mask) : 1);
+	for (size_t i = 0; i < count; ++i) {
+		unsigned int shift = 8 - bit_depth * (1 + i % per_byte);
+		dst[i] = uint8_t(((src[i / per_byte] >> shift) & mask) * factor);
+	}
+}
+
+char const *pixel_convert_isa() {
+	return kernels().load()->name;
+}
+
+bool pixel_convert_use(char const *isa) {
+	Kernels const *found = find_kernels(isa);
+	if (!found) return false;
+	kernels().store(found);
+	return true;
+}
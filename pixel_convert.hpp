@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+/*
+ * Row conversion kernels used by load_png to turn decoded PNG rows (in their native layout)
+ * into 32-bit RGBA pixels (bytes R,G,B,A in memory).
+ * Every kernel has a scalar version; on x86 there are SSE2 versions and, where the compiler
+ * can target them, SSSE3 / AVX2 versions chosen at startup by what the CPU supports.
+ */
+
+//expand 8-bit samples to RGBA (missing alpha is 0xff, gray is copied to R, G and B):
+void convert_rgb_to_rgba(uint8_t const *src, uint32_t *dst, size_t count);
+void convert_gray_to_rgba(uint8_t const *src, uint32_t *dst, size_t count);
+void convert_gray_alpha_to_rgba(uint8_t const *src, uint32_t *dst, size_t count);
+//look 8-bit indices up in a 256-entry RGBA palette:
+void convert_palette_to_rgba(uint8_t const *src, uint32_t *dst, size_t count, uint32_t const *palette);
+//...keeping only the R,G,B bytes of each entry (3 bytes per pixel, for opaque palettes):
+void convert_palette_to_rgb(uint8_t const *src, uint8_t *dst, size_t count, uint32_t const *palette);
+
+//keep the high byte of each big-endian 16-bit sample:
+void convert_strip_16(uint8_t const *src, uint8_t *dst, size_t samples);
+//unpack 1-, 2- or 4-bit samples (first sample in the high bits) to a byte each;
+//with 'scale', values are stretched to 0..255 (for gray; palette indices shouldn't be):
+void convert_unpack_bits(uint8_t const *src, uint8_t *dst, size_t count, unsigned int bit_depth, bool scale);
+
+//in place: multiply color by alpha (rounded, so 0xff alpha leaves color unchanged):
+void convert_premultiply(uint32_t *pixels, size_t count);
+//in place: swap R and B (RGBA <-> BGRA):
+void convert_swizzle_bgra(uint32_t *pixels, size_t count);
+
+//name of the kernel set in use ("scalar", "sse2", "ssse3" or "avx2"):
+char const *pixel_convert_isa();
+//switch kernel sets (e.g. to benchmark them); returns false if 'isa' isn't available here:
+bool pixel_convert_use(char const *isa);
@@ -0,0 +1,183 @@
+//png_bench: time load_png's conversion kernels against libpng's own transforms.
+//usage: png_bench [--iterations N] image.png [image.png ...]
+//For each image, decodes with libpng doing the expansion (png_set_palette_to_rgb and friends, as load_png used to)
+//and with load_png under each kernel set this CPU supports, checks they agree, and reports the best time of each.
+//Then times each kernel alone on a large synthetic row.
+
+#include "load_save_png.hpp"
+#include "mapped_file.hpp"
+#include "pixel_convert.hpp"
+
+#include <png.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct ReadSpan {
+	png_const_bytep at;
+	png_const_bytep end;
+};
+
+static void span_read_data(png_structp png, png_bytep data, png_size_t length) {
+	ReadSpan *from = reinterpret_cast< ReadSpan * >(png_get_io_ptr(png));
+	if (length > png_size_t(from->end - from->at)) png_error(png, "Error reading (truncated).");
+	memcpy(data, from->at, length);
+	from->at += length;
+}
+
+//the reference: libpng expands every pixel itself:
+static bool load_png_libpng_transforms(void const *bytes, size_t size, unsigned int *width, unsigned int *height, std::vector< uint32_t > *data) {
+	ReadSpan from;
+	from.at = reinterpret_cast< png_const_bytep >(bytes);
+	from.end = from.at + size;
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!png) return false;
+	png_infop info = png_create_info_struct(png);
+	if (!info) {
+		png_destroy_read_struct(&png, NULL, NULL);
+		return false;
+	}
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, NULL);
+		return false;
+	}
+	png_set_read_fn(png, &from, span_read_data);
+	png_read_info(png, info);
+	unsigned int w = png_get_image_width(png, info);
+	unsigned int h = png_get_image_height(png, info);
+	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
+	if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY || png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA)
+		png_set_gray_to_rgb(png);
+	if (!(png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA))
+		png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+	if (png_get_bit_depth(png, info) < 8)
+		png_set_packing(png);
+	if (png_get_bit_depth(png, info) == 16)
+		png_set_strip_16(png);
+	int passes = png_set_interlace_handling(png);
+	png_read_update_info(png, info);
+	data->resize(w * h);
+	for (int pass = 0; pass < passes; ++pass) {
+		for (unsigned int r = 0; r < h; ++r) {
+			png_read_row(png, reinterpret_cast< png_bytep >(&(*data)[r * w]), NULL);
+		}
+	}
+	png_destroy_read_struct(&png, &info, NULL);
+	*width = w;
+	*height = h;
+	return true;
+}
+
+//best-of-'iterations' time of 'fn', in milliseconds:
+static double best_ms(uint32_t iterations, std::function< void() > const &fn) {
+	double best = 1e30;
+	for (uint32_t i = 0; i < iterations; ++i) {
+		auto start = std::chrono::high_resolution_clock::now();
+		fn();
+		best = std::min(best, std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - start).count());
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	uint32_t iterations = 20;
+	std::vector< std::string > files;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--iterations" && argi + 1 < argc) {
+			iterations = std::max(1, atoi(argv[++argi]));
+		} else {
+			files.emplace_back(arg);
+		}
+	}
+	if (files.empty()) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--iterations N] image.png [image.png ...]" << std::endl;
+		return 1;
+	}
+
+	std::vector< std::string > isas;
+	std::string best_isa = pixel_convert_isa();
+	char const *all_isas[] = {"scalar", "sse2", "ssse3", "avx2"};
+	for (char const *isa : all_isas) {
+		if (pixel_convert_use(isa)) isas.emplace_back(isa);
+	}
+	pixel_convert_use(best_isa.c_str());
+	std::cout << "Kernel sets available: ";
+	for (auto const &isa : isas) std::cout << isa << (isa == best_isa ? "(default) " : " ");
+	std::cout << std::endl;
+
+	bool all_match = true;
+	for (auto const &filename : files) {
+		MappedFile file;
+		if (!file.open(filename)) return 1;
+		unsigned int w = 0, h = 0;
+		std::vector< uint32_t > reference;
+		if (!load_png_libpng_transforms(file.data, file.size, &w, &h, &reference)) {
+			std::cerr << "Failed to decode '" << filename << "'." << std::endl;
+			return 1;
+		}
+		std::cout << filename << " (" << w << "x" << h << "):" << std::endl;
+		double libpng = best_ms(iterations, [&](){
+			std::vector< uint32_t > data;
+			load_png_libpng_transforms(file.data, file.size, &w, &h, &data);
+		});
+		std::cout << "  libpng transforms: " << libpng << " ms" << std::endl;
+		for (auto const &isa : isas) {
+			pixel_convert_use(isa.c_str());
+			std::vector< uint32_t > check;
+			load_png(file.data, file.size, &w, &h, &check);
+			bool match = (check == reference);
+			all_match = all_match && match;
+			double ms = best_ms(iterations, [&](){
+				std::vector< uint32_t > data;
+				load_png(file.data, file.size, &w, &h, &data);
+			});
+			std::cout << "  load_png (" << isa << "): " << ms << " ms (" << (libpng / ms) << "x)" << (match ? "" : " MISMATCH") << std::endl;
+		}
+		pixel_convert_use(best_isa.c_str());
+	}
+
+	{ //kernels alone, on a row bigger than any cache:
+		size_t const count = 4 * 1024 * 1024;
+		std::vector< uint8_t > src(count * 4);
+		for (size_t i = 0; i < src.size(); ++i) src[i] = uint8_t(i * 2654435761u >> 24);
+		std::vector< uint32_t > dst(count);
+		std::vector< uint8_t > bytes(count * 2);
+		struct Kernel {
+			char const *name;
+			std::function< void() > run;
+		};
+		Kernel kernels[] = {
+			{"rgb_to_rgba", [&](){ convert_rgb_to_rgba(src.data(), dst.data(), count); }},
+			{"gray_to_rgba", [&](){ convert_gray_to_rgba(src.data(), dst.data(), count); }},
+			{"gray_alpha_to_rgba", [&](){ convert_gray_alpha_to_rgba(src.data(), dst.data(), count); }},
+			{"strip_16", [&](){ convert_strip_16(src.data(), bytes.data(), count); }},
+			{"premultiply", [&](){ convert_premultiply(dst.data(), count); }},
+			{"swizzle_bgra", [&](){ convert_swizzle_bgra(dst.data(), count); }},
+		};
+		std::cout << "Kernels, Mpixels/s (" << count << " pixels):" << std::endl;
+		for (auto const &kernel : kernels) {
+			std::cout << "  " << kernel.name << ":";
+			for (auto const &isa : isas) {
+				pixel_convert_use(isa.c_str());
+				double ms = best_ms(std::max(3u, iterations / 4), kernel.run);
+				std::cout << " " << isa << " " << int(count / (ms * 1000.0));
+			}
+			std::cout << std::endl;
+		}
+		pixel_convert_use(best_isa.c_str());
+	}
+
+	if (!all_match) {
+		std::cerr << "Some results differ from libpng's transforms." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,135 @@
+#include "sprite_atlas.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+void SpriteAtlas::unload() {
+	file.close();
+	converted.clear();
+	header = nullptr;
+	records = nullptr;
+	strings = nullptr;
+}
+
+bool SpriteAtlas::load(std::string const &filename) {
+	unload();
+	if (!file.open(filename)) return false;
+	return use(file.data, file.size, filename);
+}
+
+bool SpriteAtlas::load(char const *data, size_t size, std::string const &label) {
+	unload();
+	return use(data, size, label);
+}
+
+bool SpriteAtlas::load_sprite_bin(std::string const &filename, uint32_t width, uint32_t height) {
+	MappedFile bin;
+	if (!bin.open(filename)) {
+		unload();
+		return false;
+	}
+	return load_sprite_bin(bin.data, bin.size, filename, width, height);
+}
+
+bool SpriteAtlas::load_sprite_bin(char const *data, size_t size, std::string const &label, uint32_t width, uint32_t height) {
+	unload();
+	//records of: char name[20]; float min_x, max_y, max_x, min_y (pixels, upper-left origin):
+	size_t const RecordSize = SPRITE_NAME_LENGTH + 4 * sizeof(float);
+	if (size == 0 || size % RecordSize != 0 || width == 0 || height == 0) {
+		std::cerr << "Sprite table '" << label << "' is not a whole number of records." << std::endl;
+		return false;
+	}
+	uint32_t count = uint32_t(size / RecordSize);
+
+	std::vector< AtlasRecord > records(count);
+	std::string names;
+	glm::vec2 screen_size = glm::vec2(0.0f);
+	for (uint32_t i = 0; i < count; ++i) {
+		char const *at = data + i * RecordSize;
+		float rect[4];
+		memcpy(rect, at + SPRITE_NAME_LENGTH, sizeof(rect));
+		float min_x = rect[0], max_x = rect[2];
+		//flip to a lower-left origin:
+		float min_y = float(height) - rect[3];
+		float max_y = float(height) - rect[1];
+		//radius is scaled relative to the first sprite (the full-screen background):
+		if (i == 0) screen_size = glm::vec2(max_x - min_x, max_y - min_y);
+
+		AtlasRecord &record = records[i];
+		record.name_length = uint16_t(strnlen(at, SPRITE_NAME_LENGTH));
+		record.name_hash = sprite_hash(at, record.name_length);
+		record.name_offset = uint32_t(names.size());
+		record.flags = 0;
+		record.min_uv[0] = min_x / float(width);
+		record.min_uv[1] = min_y / float(height);
+		record.max_uv[0] = max_x / float(width);
+		record.max_uv[1] = max_y / float(height);
+		record.rad[0] = 13.3f * ((max_x - min_x) / screen_size.x);
+		record.rad[1] = 9.975f * ((max_y - min_y) / screen_size.y);
+		names.append(at, record.name_length);
+	}
+
+	AtlasHeader header;
+	memcpy(header.magic, "SPAT", 4);
+	header.version = ATLAS_VERSION;
+	header.sprite_count = count;
+	header.width = width;
+	header.height = height;
+	header.records_offset = sizeof(AtlasHeader);
+	header.strings_offset = header.records_offset + count * sizeof(AtlasRecord);
+	header.strings_size = uint32_t(names.size());
+
+	converted.assign((header.strings_offset + names.size() + 3) / 4, 0);
+	char *out = reinterpret_cast< char * >(converted.data());
+	memcpy(out, &header, sizeof(header));
+	memcpy(out + header.records_offset, records.data(), count * sizeof(AtlasRecord));
+	memcpy(out + header.strings_offset, names.data(), names.size());
+	return use(out, converted.size() * 4, label);
+}
+
+bool SpriteAtlas::use(char const *data, size_t size, std::string const &label) {
+	//validate everything once, so lookups never need to:
+	auto fail = [&](char const *why) {
+		std::cerr << "Atlas '" << label << "' " << why << "." << std::endl;
+		unload();
+		return false;
+	};
+	if (size < sizeof(AtlasHeader)) return fail("is too small");
+	AtlasHeader const *h = reinterpret_cast< AtlasHeader const * >(data);
+	if (memcmp(h->magic, "SPAT", 4) != 0) return fail("is not a sprite atlas");
+	if (h->version < 1 || h->version > ATLAS_VERSION) return fail("has an unsupported version");
+	if (h->records_offset % 4 != 0) return fail("has misaligned records");
+	if (h->records_offset > size || h->sprite_count > (size - h->records_offset) / sizeof(AtlasRecord)) return fail("has truncated records");
+	if (h->strings_offset > size || h->strings_size > size - h->strings_offset) return fail("has a truncated string table");
+	AtlasRecord const *r = reinterpret_cast< AtlasRecord const * >(data + h->records_offset);
+	for (uint32_t i = 0; i < h->sprite_count; ++i) {
+		if (r[i].name_offset > h->strings_size || r[i].name_length > h->strings_size - r[i].name_offset) {
+			return fail("has a sprite name outside its string table");
+		}
+	}
+
+	header = h;
+	records = r;
+	strings = data + h->strings_offset;
+	return true;
+}
+
+std::string SpriteAtlas::name(uint32_t index) const {
+	return std::string(strings + records[index].name_offset, records[index].name_length);
+}
+
+void SpriteAtlas::register_sprites(SpriteRegistry &registry) const {
+	registry.sprites.reserve(registry.sprites.size() + header->sprite_count);
+	for (uint32_t i = 0; i < header->sprite_count; ++i) {
+		AtlasRecord const &record = records[i];
+		SpriteInfo info;
+		memset(info.name, 0, sizeof(info.name));
+		memcpy(info.name, strings + record.name_offset, std::min< size_t >(record.name_length, sizeof(info.name)));
+		info.min_uv = glm::vec2(record.min_uv[0], record.min_uv[1]);
+		info.max_uv = glm::vec2(record.max_uv[0], record.max_uv[1]);
+		info.rad = glm::vec2(record.rad[0], record.rad[1]);
+		info.rotated = (record.flags & AtlasRotated) != 0;
+		registry.add(info, record.name_hash);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "sprite_registry.hpp"
+#include "mapped_file.hpp"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Sprite atlas file (".atlas"), made by pack_atlas (or converted from spriteBin.bin by make-sprite-atlas.py).
+ * Layout (little-endian, every section 4-byte aligned):
+ *   AtlasHeader
+ *   AtlasRecord[sprite_count] at records_offset
+ *   name bytes (not NUL-terminated) at strings_offset
+ * Records are final: uvs are normalized with a lower-left origin and radii are in world units,
+ * so the file is used in place (memory-mapped where possible) with no per-record parsing.
+ * The same bytes may also be embedded in an asset bundle (see asset_bundle.hpp).
+ */
+
+struct AtlasHeader {
+	char magic[4]; //"SPAT"
+	uint32_t version;
+	uint32_t sprite_count;
+	uint32_t width, height; //texture size, in pixels
+	uint32_t records_offset;
+	uint32_t strings_offset;
+	uint32_t strings_size;
+};
+static_assert(sizeof(AtlasHeader) == 32, "AtlasHeader is packed as in the file.");
+
+struct AtlasRecord {
+	uint32_t name_hash; //sprite_hash() of the name
+	uint32_t name_offset; //relative to strings_offset
+	uint16_t name_length;
+	uint16_t flags; //AtlasRotated (version 1 files: a zero high half of a 32-bit name_length)
+	float min_uv[2];
+	float max_uv[2];
+	float rad[2];
+};
+static_assert(sizeof(AtlasRecord) == 36, "AtlasRecord is packed as in the file.");
+
+enum AtlasFlags {
+	//stored turned 90 degrees clockwise, to pack tighter; min_uv/max_uv bound the stored (turned) pixels:
+	AtlasRotated = 1,
+};
+
+#define ATLAS_VERSION 2
+
+struct SpriteAtlas {
+	SpriteAtlas() = default;
+	SpriteAtlas(SpriteAtlas const &) = delete;
+	SpriteAtlas &operator=(SpriteAtlas const &) = delete;
+
+	//map (or read) and validate 'filename'; returns false (with a message on stderr) on failure:
+	bool load(std::string const &filename);
+	//validate and use atlas bytes owned by someone else (e.g. a bundle); 'data' must be 4-byte aligned
+	//and outlive this object; 'label' is only used in error messages:
+	bool load(char const *data, size_t size, std::string const &label);
+	//convert the old headerless spriteBin.bin (pixel rectangles in a width x height texture) exactly
+	//as make-sprite-atlas.py does, and use the result:
+	bool load_sprite_bin(std::string const &filename, uint32_t width, uint32_t height);
+	//the same, from spriteBin.bin bytes read by someone else ('label' is only used in error messages):
+	bool load_sprite_bin(char const *data, size_t size, std::string const &label, uint32_t width, uint32_t height);
+
+	//add every sprite to 'registry', using the stored name hashes:
+	void register_sprites(SpriteRegistry &registry) const;
+
+	std::string name(uint32_t index) const;
+
+	AtlasHeader const *header = nullptr;
+	AtlasRecord const *records = nullptr;
+	char const *strings = nullptr;
+
+private:
+	void unload();
+	bool use(char const *data, size_t size, std::string const &label);
+	MappedFile file; //unused when loaded from someone else's bytes
+	std::vector< uint32_t > converted; //atlas bytes made by load_sprite_bin()
+};
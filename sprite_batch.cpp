@@ -0,0 +1,481 @@
+#include "sprite_batch.hpp"
+#include "compile_program.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <stdexcept>
+#include <cassert>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+SpriteBatch::SpriteBatch() :
+#if SPRITE_INSTANCING
+	stream(sizeof(Instance))
+#else
+	stream(sizeof(Vertex))
+#endif
+{
+	{ //compile shader program:
+#if SPRITE_INSTANCING
+		//one instance per sprite; corners of the unit quad are expanded here:
+		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
+			"#version 330\n"
+			"uniform mat4 mvp;\n"
+			"in vec2 Corner;\n"
+			"in vec2 At;\n"
+			"in vec2 Radius;\n"
+			"in vec2 MinUV;\n"
+			"in vec2 MaxUV;\n"
+			"in vec4 Tint;\n"
+			"in float Angle;\n"
+			"out vec2 texCoord;\n"
+			"out vec4 color;\n"
+			"void main() {\n"
+			"	vec2 right = vec2(cos(Angle), sin(Angle));\n"
+			"	vec2 up = vec2(-right.y, right.x);\n"
+			"	vec2 local = Corner * Radius;\n"
+			"	gl_Position = mvp * vec4(At + right * local.x + up * local.y, 0.0, 1.0);\n"
+			"	color = Tint;\n"
+			"	texCoord = mix(MinUV, MaxUV, 0.5 * Corner + 0.5);\n"
+			"}\n"
+		);
+#elif SPRITE_COMPACT_VERTEX
+		//positions arrive as camera-space snorm16, scaled by 1/PositionRange:
+		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
+			"#version 330\n"
+			"uniform mat4 mvp;\n"
+			"uniform float PositionRange;\n"
+			"in vec2 Position;\n"
+			"in vec2 TexCoord;\n"
+			"in vec4 Color;\n"
+			"out vec2 texCoord;\n"
+			"out vec4 color;\n"
+			"void main() {\n"
+			"	gl_Position = mvp * vec4(Position * PositionRange, 0.0, 1.0);\n"
+			"	color = Color;\n"
+			"	texCoord = TexCoord;\n"
+			"}\n"
+		);
+#else
+		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
+			"#version 330\n"
+			"uniform mat4 mvp;\n"
+			"in vec4 Position;\n"
+			"in vec2 TexCoord;\n"
+			"in vec4 Color;\n"
+			"out vec2 texCoord;\n"
+			"out vec4 color;\n"
+			"void main() {\n"
+			"	gl_Position = mvp * Position;\n"
+			"	color = Color;\n"
+			"	texCoord = TexCoord;\n"
+			"}\n"
+		);
+#endif
+
+		GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER,
+			"#version 330\n"
+			"uniform sampler2D tex;\n"
+			"in vec4 color;\n"
+			"in vec2 texCoord;\n"
+			"out vec4 fragColor;\n"
+			"void main() {\n"
+			"	fragColor = texture(tex, texCoord) * color;\n"
+			"}\n"
+		);
+
+		program = link_program(fragment_shader, vertex_shader);
+
+		//look up uniform locations:
+		program_mvp = glGetUniformLocation(program, "mvp");
+		if (program_mvp == -1U) throw std::runtime_error("no uniform named mvp");
+#if !SPRITE_INSTANCING && SPRITE_COMPACT_VERTEX
+		GLuint program_PositionRange = glGetUniformLocation(program, "PositionRange");
+		if (program_PositionRange == -1U) throw std::runtime_error("no uniform named PositionRange");
+		glUseProgram(program);
+		glUniform1f(program_PositionRange, PositionRange);
+		glUseProgram(0);
+#endif
+		program_tex = glGetUniformLocation(program, "tex");
+		if (program_tex == -1U) throw std::runtime_error("no uniform named tex");
+	}
+
+#if SPRITE_INSTANCING
+	//look up attribute locations:
+	GLuint program_Corner = glGetAttribLocation(program, "Corner");
+	if (program_Corner == -1U) throw std::runtime_error("no attribute named Corner");
+	program_At = glGetAttribLocation(program, "At");
+	if (program_At == -1U) throw std::runtime_error("no attribute named At");
+	program_Radius = glGetAttribLocation(program, "Radius");
+	if (program_Radius == -1U) throw std::runtime_error("no attribute named Radius");
+	program_MinUV = glGetAttribLocation(program, "MinUV");
+	if (program_MinUV == -1U) throw std::runtime_error("no attribute named MinUV");
+	program_MaxUV = glGetAttribLocation(program, "MaxUV");
+	if (program_MaxUV == -1U) throw std::runtime_error("no attribute named MaxUV");
+	program_Tint = glGetAttribLocation(program, "Tint");
+	if (program_Tint == -1U) throw std::runtime_error("no attribute named Tint");
+	program_Angle = glGetAttribLocation(program, "Angle");
+	if (program_Angle == -1U) throw std::runtime_error("no attribute named Angle");
+
+	{ //create unit quad, drawn as a triangle strip once per instance:
+		glm::vec2 corners[4] = {
+			glm::vec2(-1.0f,-1.0f),
+			glm::vec2(-1.0f, 1.0f),
+			glm::vec2( 1.0f,-1.0f),
+			glm::vec2( 1.0f, 1.0f),
+		};
+		glGenBuffers(1, &quad_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, quad_buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	}
+
+	{ //create vao; per-instance pointers are set at draw time, since 3.3 has no base instance:
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, quad_buffer);
+		glVertexAttribPointer(program_Corner, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (GLbyte *)0);
+		glEnableVertexAttribArray(program_Corner);
+		for (GLuint attrib : {program_At, program_Radius, program_MinUV, program_MaxUV, program_Tint, program_Angle}) {
+			glVertexAttribDivisor(attrib, 1);
+			glEnableVertexAttribArray(attrib);
+		}
+	}
+#else
+	//look up attribute locations:
+	program_Position = glGetAttribLocation(program, "Position");
+	if (program_Position == -1U) throw std::runtime_error("no attribute named Position");
+	program_TexCoord = glGetAttribLocation(program, "TexCoord");
+	if (program_TexCoord == -1U) throw std::runtime_error("no attribute named TexCoord");
+	program_Color = glGetAttribLocation(program, "Color");
+	if (program_Color == -1U) throw std::runtime_error("no attribute named Color");
+
+	{ //create vao; pointers are set at draw time, since caches and the stream live in different buffers:
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glEnableVertexAttribArray(program_Position);
+		glEnableVertexAttribArray(program_TexCoord);
+		glEnableVertexAttribArray(program_Color);
+	}
+#endif
+	glBindVertexArray(0);
+}
+
+SpriteBatch::~SpriteBatch() {
+	for (auto &cache : caches) {
+		if (cache.buffer) glDeleteBuffers(1, &cache.buffer);
+		cache.buffer = 0;
+	}
+	glDeleteVertexArrays(1, &vao);
+	vao = 0;
+#if SPRITE_INSTANCING
+	glDeleteBuffers(1, &quad_buffer);
+	quad_buffer = 0;
+#endif
+	glDeleteProgram(program);
+	program = 0;
+}
+
+uint16_t SpriteBatch::texture_slot(GLuint tex) {
+	//there are only ever a handful of textures, so a linear scan is fine:
+	for (uint32_t i = 0; i < textures.size(); ++i) {
+		if (textures[i] == tex) return uint16_t(i);
+	}
+	if (textures.size() >= 0xffff) throw std::runtime_error("SpriteBatch: too many textures.");
+	textures.emplace_back(tex);
+	return uint16_t(textures.size() - 1);
+}
+
+void SpriteBatch::draw(Instance const &sprite, GLuint tex, uint8_t layer, BlendMode blend, uint16_t depth) {
+	keys.emplace_back(make_key(layer, texture_slot(tex), blend, depth), uint32_t(queued.size()));
+	queued.emplace_back(sprite);
+	if (sprite.Angle != 0.0f) any_rotated = true;
+}
+
+bool SpriteBatch::cache_valid(uint32_t id) const {
+	return id < caches.size() && caches[id].valid;
+}
+
+void SpriteBatch::invalidate_cache(uint32_t id) {
+	if (id >= caches.size()) return;
+	Cache &cache = caches[id];
+	cache.valid = false;
+	cache.queued.clear();
+	cache.keys.clear();
+	cache.any_rotated = false;
+}
+
+void SpriteBatch::cache_draw(uint32_t id, Instance const &sprite, GLuint tex, uint8_t layer, BlendMode blend, uint16_t depth) {
+	if (id >= caches.size()) caches.resize(id + 1);
+	Cache &cache = caches[id];
+	assert(!cache.valid && "invalidate_cache() before recording again");
+	cache.keys.emplace_back(make_key(layer, texture_slot(tex), blend, depth), uint32_t(cache.queued.size()));
+	cache.queued.emplace_back(sprite);
+	if (sprite.Angle != 0.0f) cache.any_rotated = true;
+}
+
+void SpriteBatch::draw_cache(uint32_t id) {
+	if (id >= caches.size()) caches.resize(id + 1);
+	caches[id].scheduled = true;
+}
+
+//stable LSD radix sort on the keys, one byte per pass; passes where every key has the same byte are skipped:
+static void radix_sort(std::vector< std::pair< uint64_t, uint32_t > > &keys, std::vector< std::pair< uint64_t, uint32_t > > &scratch) {
+	if (keys.empty()) return;
+	scratch.resize(keys.size());
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		uint32_t counts[256] = { 0 };
+		for (auto const &k : keys) {
+			counts[(k.first >> shift) & 0xff] += 1;
+		}
+		if (counts[(keys[0].first >> shift) & 0xff] == keys.size()) continue;
+
+		uint32_t offsets[256];
+		uint32_t sum = 0;
+		for (uint32_t b = 0; b < 256; ++b) {
+			offsets[b] = sum;
+			sum += counts[b];
+		}
+		for (auto const &k : keys) {
+			scratch[offsets[(k.first >> shift) & 0xff]++] = k;
+		}
+		keys.swap(scratch);
+	}
+}
+
+#if !SPRITE_INSTANCING
+#if SPRITE_COMPACT_VERTEX
+static inline glm::i16vec2 pack_position(glm::vec2 const &position, float range) {
+	glm::vec2 p = glm::clamp(position / range, glm::vec2(-1.0f), glm::vec2(1.0f));
+	//(rounded half away from zero, as std::round() would, without the library call)
+	return glm::i16vec2(int16_t(p.x * 32767.0f + (p.x < 0.0f ? -0.5f : 0.5f)), int16_t(p.y * 32767.0f + (p.y < 0.0f ? -0.5f : 0.5f)));
+}
+static inline glm::u16vec2 pack_tex_coord(float u, float v) {
+	glm::vec2 t = glm::clamp(glm::vec2(u, v), glm::vec2(0.0f), glm::vec2(1.0f));
+	return glm::u16vec2(uint16_t(t.x * 65535.0f + 0.5f), uint16_t(t.y * 65535.0f + 0.5f));
+}
+#endif
+
+template< bool Rotated >
+void SpriteBatch::expand_quads(std::vector< Instance > const &sprites, Vertex *out) {
+	for (auto const &sprite : sprites) {
+		//corners (-,-) (-,+) (+,-) (+,+), as the instanced shader places them:
+		glm::vec2 const &at = sprite.At;
+		glm::vec2 const &rad = sprite.Radius;
+		glm::vec2 corners[4];
+		if (Rotated) {
+			float c = std::cos(sprite.Angle), s = std::sin(sprite.Angle);
+			glm::vec2 right = glm::vec2(c, s) * rad.x;
+			glm::vec2 up = glm::vec2(-s, c) * rad.y;
+			corners[0] = at - right - up;
+			corners[1] = at - right + up;
+			corners[2] = at + right - up;
+			corners[3] = at + right + up;
+		} else {
+			corners[0] = glm::vec2(at.x - rad.x, at.y - rad.y);
+			corners[1] = glm::vec2(at.x - rad.x, at.y + rad.y);
+			corners[2] = glm::vec2(at.x + rad.x, at.y - rad.y);
+			corners[3] = glm::vec2(at.x + rad.x, at.y + rad.y);
+		}
+
+		//a quad with a duplicated first and last vertex, so quads join into one strip:
+#if SPRITE_COMPACT_VERTEX
+		out[0] = Vertex(pack_position(corners[0], PositionRange), pack_tex_coord(sprite.MinUV.x, sprite.MinUV.y), sprite.Tint);
+		out[2] = Vertex(pack_position(corners[1], PositionRange), pack_tex_coord(sprite.MinUV.x, sprite.MaxUV.y), sprite.Tint);
+		out[3] = Vertex(pack_position(corners[2], PositionRange), pack_tex_coord(sprite.MaxUV.x, sprite.MinUV.y), sprite.Tint);
+		out[4] = Vertex(pack_position(corners[3], PositionRange), pack_tex_coord(sprite.MaxUV.x, sprite.MaxUV.y), sprite.Tint);
+#else
+		out[0] = Vertex(corners[0], glm::vec2(sprite.MinUV.x, sprite.MinUV.y), sprite.Tint);
+		out[2] = Vertex(corners[1], glm::vec2(sprite.MinUV.x, sprite.MaxUV.y), sprite.Tint);
+		out[3] = Vertex(corners[2], glm::vec2(sprite.MaxUV.x, sprite.MinUV.y), sprite.Tint);
+		out[4] = Vertex(corners[3], glm::vec2(sprite.MaxUV.x, sprite.MaxUV.y), sprite.Tint);
+#endif
+		out[1] = out[0];
+		out[5] = out[4];
+		out += 6;
+	}
+}
+#endif //!SPRITE_INSTANCING
+
+static void set_blend(BlendMode blend) {
+	if (blend == BlendOpaque) {
+		glDisable(GL_BLEND);
+	} else {
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, blend == BlendAdditive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+	}
+}
+
+void SpriteBatch::sort_sprites(std::vector< Instance > const &queued_, std::vector< std::pair< uint64_t, uint32_t > > &keys_, std::vector< Instance > &sorted_, std::vector< Run > &runs_) {
+	radix_sort(keys_, keys_scratch);
+
+	sorted_.clear();
+	sorted_.reserve(keys_.size());
+	for (auto const &k : keys_) {
+		sorted_.emplace_back(queued_[k.second]);
+	}
+
+	runs_.clear();
+	for (uint32_t begin = 0; begin < keys_.size(); /* later */) {
+		uint16_t slot = key_texture_slot(keys_[begin].first);
+		BlendMode blend = key_blend(keys_[begin].first);
+		uint32_t end = begin + 1;
+		while (end < keys_.size() && key_texture_slot(keys_[end].first) == slot && key_blend(keys_[end].first) == blend) {
+			++end;
+		}
+		runs_.emplace_back(slot, blend, begin, end - begin);
+		begin = end;
+	}
+}
+
+size_t SpriteBatch::record_bytes(uint32_t count) {
+#if SPRITE_INSTANCING
+	return count * sizeof(Instance);
+#else
+	return count * 6 * sizeof(Vertex);
+#endif
+}
+
+void SpriteBatch::write_records(std::vector< Instance > const &sorted_, bool rotated, void *dst) {
+#if SPRITE_INSTANCING
+	(void)rotated;
+	memcpy(dst, sorted_.data(), record_bytes(sorted_.size()));
+#else
+	if (rotated) {
+		expand_quads< true >(sorted_, reinterpret_cast< Vertex * >(dst));
+	} else {
+		expand_quads< false >(sorted_, reinterpret_cast< Vertex * >(dst));
+	}
+#endif
+}
+
+void SpriteBatch::draw_runs(std::vector< Run > const &runs_, GLuint buffer, GLint first) {
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+#if !SPRITE_INSTANCING
+	//point the vertex attributes at 'buffer':
+#if SPRITE_COMPACT_VERTEX
+	glVertexAttribPointer(program_Position, 2, GL_SHORT, GL_TRUE, sizeof(Vertex), (GLbyte *)0);
+	glVertexAttribPointer(program_TexCoord, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + sizeof(glm::i16vec2));
+	glVertexAttribPointer(program_Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + sizeof(glm::i16vec2) + sizeof(glm::u16vec2));
+#else
+	glVertexAttribPointer(program_Position, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0);
+	glVertexAttribPointer(program_TexCoord, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + sizeof(glm::vec2));
+	glVertexAttribPointer(program_Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + sizeof(glm::vec2) + sizeof(glm::vec2));
+#endif
+#endif
+
+	for (auto const &run : runs_) {
+		if (run.slot != bound_slot) {
+			glBindTexture(GL_TEXTURE_2D, textures[run.slot]);
+			bound_slot = run.slot;
+			stats.state_changes += 1;
+		}
+		if (int(run.blend) != bound_blend) {
+			set_blend(run.blend);
+			bound_blend = int(run.blend);
+			stats.state_changes += 1;
+		}
+
+#if SPRITE_INSTANCING
+		//point the per-instance attributes at this run's records:
+		GLbyte *base = (GLbyte *)0 + (first + run.begin) * sizeof(Instance);
+		glVertexAttribPointer(program_At, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, At));
+		glVertexAttribPointer(program_Radius, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, Radius));
+		glVertexAttribPointer(program_MinUV, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, MinUV));
+		glVertexAttribPointer(program_MaxUV, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, MaxUV));
+		glVertexAttribPointer(program_Tint, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), base + offsetof(Instance, Tint));
+		glVertexAttribPointer(program_Angle, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, Angle));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, run.count);
+#else
+		glDrawArrays(GL_TRIANGLE_STRIP, first + run.begin * 6, run.count * 6);
+#endif
+		stats.batches += 1;
+	}
+}
+
+void SpriteBatch::upload_cache(Cache &cache) {
+	size_t bytes = record_bytes(cache.sorted.size());
+	if (bytes == 0) return;
+	if (cache.buffer == 0) glGenBuffers(1, &cache.buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, cache.buffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+	void *dst = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!dst) throw std::runtime_error("Failed to map sprite cache buffer.");
+	write_records(cache.sorted, cache.any_rotated, dst);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	stats.bytes_uploaded += bytes;
+}
+
+void SpriteBatch::flush(glm::mat4 const &mvp) {
+	upload(mvp);
+	submit();
+}
+
+void SpriteBatch::discard() {
+	for (auto &cache : caches) {
+		cache.scheduled = false;
+		if (cache.valid) continue;
+		cache.queued.clear();
+		cache.keys.clear();
+		cache.any_rotated = false;
+	}
+	queued.clear();
+	keys.clear();
+	any_rotated = false;
+}
+
+void SpriteBatch::upload(glm::mat4 const &mvp) {
+	stats = Stats();
+	upload_mvp = mvp;
+
+	//finish any cache recordings:
+	for (auto &cache : caches) {
+		if (cache.valid || cache.queued.empty()) continue;
+		sort_sprites(cache.queued, cache.keys, cache.sorted, cache.runs);
+		cache.queued.clear();
+		cache.keys.clear();
+		upload_cache(cache);
+		cache.valid = true;
+	}
+
+	//upload streamed sprites, in sorted order:
+	upload_first = 0;
+	if (!queued.empty()) {
+		sort_sprites(queued, keys, sorted, runs);
+		void *mapped = stream.map(record_bytes(sorted.size()) / stream.stride);
+		write_records(sorted, any_rotated, mapped);
+		upload_first = stream.unmap();
+		stats.bytes_uploaded += record_bytes(sorted.size());
+	}
+}
+
+void SpriteBatch::submit() {
+	bound_slot = 0xffff;
+	bound_blend = -1;
+
+	glUseProgram(program);
+	glUniform1i(program_tex, 0);
+	glUniformMatrix4fv(program_mvp, 1, GL_FALSE, glm::value_ptr(upload_mvp));
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vao);
+
+	for (auto &cache : caches) {
+		if (!cache.scheduled) continue;
+		cache.scheduled = false;
+		if (!cache.valid) continue;
+		draw_runs(cache.runs, cache.buffer, 0);
+		stats.sprites += cache.sorted.size();
+	}
+
+	if (!queued.empty()) {
+		draw_runs(runs, stream.buffer, upload_first);
+		stats.sprites += queued.size();
+	}
+
+	glBindVertexArray(0);
+
+	queued.clear();
+	keys.clear();
+	any_rotated = false;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "GL.hpp"
+#include "vertex_stream.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Sprite batching.
+ * Each submitted sprite carries a 64-bit sort key built from its layer, texture, blend mode and depth.
+ * flush() radix-sorts the keys (stably, so submission order breaks ties), uploads all sprites through
+ * one VertexStream region, and issues one draw per run of sprites sharing a texture and blend mode.
+ */
+
+//Draw sprites as instanced unit quads (1) or as expanded triangle-strip quads (0).
+//The game uses instancing; 'make' also compiles the expanded path (in both layouts) so it keeps building:
+#ifndef SPRITE_INSTANCING
+#define SPRITE_INSTANCING 1
+#endif
+
+//When not instancing, pack expanded vertices into 12 bytes (1) instead of 20 (0).
+//(Instanced sprites are 40-byte Instance records either way; this only matters with SPRITE_INSTANCING 0.)
+//Off by default: quantizing on the CPU costs more than the smaller upload saves, at least with the
+//write-combined stream buffer -- 20k sprites took ~1.1ms to upload compact vs. ~0.9ms full.
+#ifndef SPRITE_COMPACT_VERTEX
+#define SPRITE_COMPACT_VERTEX 0
+#endif
+
+enum BlendMode {
+	BlendAlpha = 0,
+	BlendAdditive = 1,
+	BlendOpaque = 2,
+};
+
+struct SpriteBatch {
+	SpriteBatch();
+	~SpriteBatch();
+	SpriteBatch(SpriteBatch const &) = delete;
+	SpriteBatch &operator=(SpriteBatch const &) = delete;
+
+	//one submitted sprite (also the per-instance record when instancing):
+	struct Instance {
+		Instance(glm::vec2 const &At_, glm::vec2 const &Radius_, glm::vec2 const &MinUV_, glm::vec2 const &MaxUV_, glm::u8vec4 const &Tint_, float Angle_) :
+			At(At_), Radius(Radius_), MinUV(MinUV_), MaxUV(MaxUV_), Tint(Tint_), Angle(Angle_) { }
+		glm::vec2 At;
+		glm::vec2 Radius;
+		glm::vec2 MinUV;
+		glm::vec2 MaxUV;
+		glm::u8vec4 Tint;
+		float Angle;
+	};
+	static_assert(sizeof(Instance) == 40, "Instance is nicely packed.");
+
+	//queue a sprite; layers draw in increasing order, then texture, blend mode, and depth:
+	void draw(Instance const &sprite, GLuint tex, uint8_t layer, BlendMode blend = BlendAlpha, uint16_t depth = 0);
+
+	//sort, upload, and draw everything queued since the last flush():
+	void flush(glm::mat4 const &mvp);
+	//or drop it all (sprites, draw_cache() calls, and unfinished cache recordings), e.g. to build a frame again:
+	void discard();
+	//flush() in two steps, so each can be timed: upload() sorts and writes GL-side records, submit() issues the draws:
+	void upload(glm::mat4 const &mvp);
+	void submit();
+
+	//Retained sprites, for content that rarely changes (e.g., a room's background and landmarks).
+	//cache_draw() records into cache 'id'; the next flush() sorts and uploads the recording once, and after that
+	//every flush() following a draw_cache(id) redraws it from GPU memory. Caches draw beneath streamed sprites.
+	//invalidate_cache() drops a recording so it can be made again:
+	bool cache_valid(uint32_t id) const;
+	void invalidate_cache(uint32_t id);
+	void cache_draw(uint32_t id, Instance const &sprite, GLuint tex, uint8_t layer, BlendMode blend = BlendAlpha, uint16_t depth = 0);
+	void draw_cache(uint32_t id);
+
+	//counters for the most recent flush():
+	struct Stats {
+		uint32_t sprites = 0;
+		uint32_t batches = 0; //draw calls issued
+		uint32_t state_changes = 0; //texture binds + blend mode switches
+		size_t bytes_uploaded = 0;
+	} stats;
+
+	//sort key layout, most significant first: layer(8) texture slot(16) blend(8) depth(16) unused(16)
+	static uint64_t make_key(uint8_t layer, uint16_t texture_slot, BlendMode blend, uint16_t depth) {
+		return (uint64_t(layer) << 56) | (uint64_t(texture_slot) << 40) | (uint64_t(blend) << 32) | (uint64_t(depth) << 16);
+	}
+	static uint16_t key_texture_slot(uint64_t key) { return uint16_t(key >> 40); }
+	static BlendMode key_blend(uint64_t key) { return BlendMode(uint8_t(key >> 32)); }
+
+private:
+	uint16_t texture_slot(GLuint tex);
+
+	//consecutive sorted sprites sharing a texture and blend mode, drawn with one call:
+	struct Run {
+		Run(uint16_t slot_, BlendMode blend_, uint32_t begin_, uint32_t count_) : slot(slot_), blend(blend_), begin(begin_), count(count_) { }
+		uint16_t slot;
+		BlendMode blend;
+		uint32_t begin;
+		uint32_t count;
+	};
+
+	//sort 'queued' by 'keys' into 'sorted' and find its runs:
+	void sort_sprites(std::vector< Instance > const &queued, std::vector< std::pair< uint64_t, uint32_t > > &keys, std::vector< Instance > &sorted, std::vector< Run > &runs);
+	//size and contents of the GL-side records (instances or expanded vertices) for sorted sprites:
+	static size_t record_bytes(uint32_t count);
+	void write_records(std::vector< Instance > const &sorted, bool rotated, void *dst);
+	//issue draws for 'runs', whose records start at record 'first' of 'buffer':
+	void draw_runs(std::vector< Run > const &runs, GLuint buffer, GLint first);
+
+	//queued sprites and their (key, index) pairs, plus scratch space for sorting:
+	std::vector< Instance > queued;
+	std::vector< std::pair< uint64_t, uint32_t > > keys, keys_scratch;
+	std::vector< Instance > sorted;
+	std::vector< Run > runs;
+	//does any queued sprite have a non-zero angle?
+	bool any_rotated = false;
+	//textures referenced by key slots:
+	std::vector< GLuint > textures;
+	//what upload() left for submit():
+	glm::mat4 upload_mvp = glm::mat4(1.0f);
+	GLint upload_first = 0;
+	//texture and blend mode currently set (reset at each submit()):
+	uint16_t bound_slot = 0xffff;
+	int bound_blend = -1;
+
+	struct Cache {
+		//recording, waiting for the next flush():
+		std::vector< Instance > queued;
+		std::vector< std::pair< uint64_t, uint32_t > > keys;
+		bool any_rotated = false;
+		//uploaded contents:
+		std::vector< Instance > sorted;
+		std::vector< Run > runs;
+		GLuint buffer = 0;
+		bool valid = false;
+		bool scheduled = false;
+	};
+	std::vector< Cache > caches;
+	void upload_cache(Cache &cache);
+
+	GLuint program = 0;
+	GLuint program_mvp = 0;
+	GLuint program_tex = 0;
+	GLuint vao = 0;
+
+#if SPRITE_INSTANCING
+	GLuint program_At = 0;
+	GLuint program_Radius = 0;
+	GLuint program_MinUV = 0;
+	GLuint program_MaxUV = 0;
+	GLuint program_Tint = 0;
+	GLuint program_Angle = 0;
+	GLuint quad_buffer = 0;
+#else
+	GLuint program_Position = 0;
+	GLuint program_TexCoord = 0;
+	GLuint program_Color = 0;
+#endif
+
+#if !SPRITE_INSTANCING && SPRITE_COMPACT_VERTEX
+	//positions are camera-space (mvp is still applied in the shader, so caches don't depend on it), stored as
+	//snorm16 scaled by 1/PositionRange; texcoords are unorm16 atlas coordinates:
+	struct Vertex {
+		Vertex(glm::i16vec2 const &Position_, glm::u16vec2 const &TexCoord_, glm::u8vec4 const &Color_) :
+			Position(Position_), TexCoord(TexCoord_), Color(Color_) { }
+		glm::i16vec2 Position;
+		glm::u16vec2 TexCoord;
+		glm::u8vec4 Color;
+	};
+	static_assert(sizeof(Vertex) == 12, "Vertex is nicely packed.");
+	//camera-space extent representable by a compact position, either side of the origin (the game's camera sits
+	//there and sees about 13x10 units, so this leaves room for sprites hanging off screen at ~0.001-unit steps):
+	static constexpr float PositionRange = 32.0f;
+#elif !SPRITE_INSTANCING
+	struct Vertex {
+		Vertex(glm::vec2 const &Position_, glm::vec2 const &TexCoord_, glm::u8vec4 const &Color_) :
+			Position(Position_), TexCoord(TexCoord_), Color(Color_) { }
+		glm::vec2 Position;
+		glm::vec2 TexCoord;
+		glm::u8vec4 Color;
+	};
+	static_assert(sizeof(Vertex) == 20, "Vertex is nicely packed.");
+#endif
+
+#if !SPRITE_INSTANCING
+	//write six strip vertices per sprite; the Rotated=false version skips the trig altogether:
+	template< bool Rotated >
+	static void expand_quads(std::vector< Instance > const &sprites, Vertex *out);
+#endif
+
+	VertexStream stream;
+};
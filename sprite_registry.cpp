@@ -0,0 +1,77 @@
+#include "sprite_registry.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+constexpr SpriteId SpriteRegistry::InvalidSprite;
+
+static std::string sprite_name(SpriteInfo const &info) {
+	return std::string(info.name, strnlen(info.name, SPRITE_NAME_LENGTH));
+}
+
+void SpriteRegistry::insert(uint32_t hash, SpriteId id) {
+	uint32_t mask = table.size() - 1;
+	for (uint32_t slot = hash & mask; /* later */; slot = (slot + 1) & mask) {
+		if (table[slot].second == InvalidSprite) {
+			table[slot] = std::make_pair(hash, id);
+			return;
+		}
+	}
+}
+
+SpriteId SpriteRegistry::add(SpriteInfo const &info) {
+	return add(info, sprite_hash(info.name, SPRITE_NAME_LENGTH));
+}
+
+SpriteId SpriteRegistry::add(SpriteInfo const &info, uint32_t hash) {
+	SpriteId existing = find(hash);
+	if (existing != InvalidSprite) {
+		if (sprite_name(sprites[existing]) == sprite_name(info)) {
+			throw std::runtime_error("Sprite '" + sprite_name(info) + "' was added twice.");
+		}
+		throw std::runtime_error("Sprite names '" + sprite_name(sprites[existing]) + "' and '" + sprite_name(info) + "' have the same hash.");
+	}
+	if (sprites.size() >= InvalidSprite) throw std::runtime_error("Too many sprites.");
+
+	SpriteId id = SpriteId(sprites.size());
+	sprites.emplace_back(info);
+	sprites.back().hash = hash;
+	hashes.emplace_back(hash);
+
+	//keep the table at most half full so probe runs stay short:
+	if (sprites.size() * 2 > table.size()) {
+		size_t size = 16;
+		while (size < sprites.size() * 2) size *= 2;
+		table.assign(size, std::make_pair(0u, InvalidSprite));
+		for (uint32_t i = 0; i < sprites.size(); ++i) {
+			insert(hashes[i], SpriteId(i));
+		}
+	} else {
+		insert(hash, id);
+	}
+	return id;
+}
+
+SpriteId SpriteRegistry::find(uint32_t hash) const {
+	if (table.empty()) return InvalidSprite;
+	uint32_t mask = table.size() - 1;
+	for (uint32_t slot = hash & mask; /* later */; slot = (slot + 1) & mask) {
+		if (table[slot].second == InvalidSprite) return InvalidSprite;
+		if (table[slot].first == hash) return table[slot].second;
+	}
+}
+
+SpriteInfo const &SpriteRegistry::operator[](uint32_t hash) const {
+	SpriteId id = find(hash);
+	if (id == InvalidSprite) {
+		throw std::runtime_error("No sprite with name hash " + std::to_string(hash) + ".");
+	}
+	return sprites[id];
+}
+
+SpriteInfo const &SpriteRegistry::current(SpriteInfo const &info) const {
+	//(copies of registered sprites carry their hash; the name may have been truncated)
+	SpriteId id = find(info.hash ? info.hash : sprite_hash(info.name, SPRITE_NAME_LENGTH));
+	return (id == InvalidSprite ? info : sprites[id]);
+}
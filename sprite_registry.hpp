@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sprite lookup by name.
+ * Names are hashed with FNV-1a; the "name"_sprite literal computes the hash at compile time,
+ * so a lookup is one probe (rarely more) into an open-addressing table -- no string handling.
+ * Two different names that hash alike are reported when the second is added.
+ */
+
+//longest sprite name (names this long are not NUL-terminated):
+#define SPRITE_NAME_LENGTH 20
+
+constexpr uint32_t sprite_hash(char const *name, size_t length, uint32_t hash = 2166136261u) {
+	return (length == 0 || *name == '\0') ? hash : sprite_hash(name + 1, length - 1, (hash ^ uint8_t(*name)) * 16777619u);
+}
+
+constexpr uint32_t operator"" _sprite(char const *name, size_t length) {
+	return sprite_hash(name, length);
+}
+
+struct SpriteInfo {
+	char name[SPRITE_NAME_LENGTH];
+	glm::vec2 min_uv = glm::vec2(4.0f / 500.0f, 115.0f / 240.f);
+	glm::vec2 max_uv = glm::vec2(163.0f / 500.0f, 234.0f / 240.0f);
+	glm::vec2 rad = glm::vec2(13.3f, 9.975f);
+	//stored turned 90 degrees clockwise in the texture (see sprite_atlas.hpp); 'rad' is as drawn:
+	bool rotated = false;
+	//hash it was registered under (of the full name, which may be longer than 'name'); 0 if never registered:
+	uint32_t hash = 0;
+};
+
+typedef uint16_t SpriteId;
+
+struct SpriteRegistry {
+	//add a sprite; throws if its name (or its name's hash) is already present:
+	SpriteId add(SpriteInfo const &info);
+	//...with its name hash already known (names longer than SPRITE_NAME_LENGTH are truncated in 'info'):
+	SpriteId add(SpriteInfo const &info, uint32_t hash);
+
+	//id of the sprite whose name has 'hash', or InvalidSprite:
+	SpriteId find(uint32_t hash) const;
+	static constexpr SpriteId InvalidSprite = 0xffff;
+
+	//sprite whose name has 'hash' (e.g., sprites["player1"_sprite]); throws if there isn't one:
+	SpriteInfo const &operator[](uint32_t hash) const;
+
+	//the sprite registered under the same name hash as 'info' (e.g., to refresh a copy taken before the
+	//table was reloaded), or 'info' itself if there isn't one:
+	SpriteInfo const &current(SpriteInfo const &info) const;
+
+	//name hash of sprite 'id':
+	uint32_t hash(SpriteId id) const { return hashes[id]; }
+
+	//indexed by SpriteId:
+	std::vector< SpriteInfo > sprites;
+
+private:
+	//(name hash, id) pairs; size is a power of two, at most half full:
+	std::vector< std::pair< uint32_t, SpriteId > > table;
+	//name hash of each sprite, for rebuilding the table:
+	std::vector< uint32_t > hashes;
+	void insert(uint32_t hash, SpriteId id);
+};
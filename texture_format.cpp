@@ -0,0 +1,40 @@
+#include "texture_format.hpp"
+
+TextureFormat texture_format(PngImage const &image) {
+	TextureFormat ret;
+	bool wide = (image.bit_depth == 16);
+	ret.type = (wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE);
+	if (image.channels == 1) {
+		ret.internal_format = (wide ? GL_R16 : GL_R8);
+		ret.format = GL_RED;
+		if (image.palette.empty()) {
+			ret.swizzle[0] = ret.swizzle[1] = ret.swizzle[2] = GL_RED;
+			ret.swizzle[3] = GL_ONE;
+		}
+	} else if (image.channels == 2) {
+		ret.internal_format = (wide ? GL_RG16 : GL_RG8);
+		ret.format = GL_RG;
+		ret.swizzle[0] = ret.swizzle[1] = ret.swizzle[2] = GL_RED;
+		ret.swizzle[3] = GL_GREEN;
+	} else if (image.channels == 3) {
+		ret.internal_format = (wide ? GL_RGB16 : GL_RGB8);
+		ret.format = GL_RGB;
+	} else {
+		ret.internal_format = (wide ? GL_RGBA16 : GL_RGBA8);
+		ret.format = GL_RGBA;
+	}
+
+	size_t row_size = image.row_size();
+	ret.unpack_alignment = 1;
+	while (ret.unpack_alignment < 8 && row_size % (ret.unpack_alignment * 2) == 0) {
+		ret.unpack_alignment *= 2;
+	}
+	return ret;
+}
+
+TextureFormat texture_allocate(PngImage const &image) {
+	TextureFormat format = texture_format(image);
+	glTexImage2D(GL_TEXTURE_2D, 0, format.internal_format, image.width, image.height, 0, format.format, format.type, nullptr);
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+	return format;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "GL.hpp"
+#include "load_save_png.hpp"
+
+/*
+ * GL formats for uploading a PngImage as it is, rather than expanded to RGBA8:
+ * gray becomes GL_R8 (with a swizzle, so shaders still see gray, gray, gray, 1), gray + alpha GL_RG8,
+ * RGB GL_RGB8, and 16-bit samples the 16-bit versions of those.
+ * Palette indices become GL_R8 with no swizzle (a shader would have to look them up itself; load with
+ * PngLoadExpandPalette to get RGB(A) instead).
+ */
+
+struct TextureFormat {
+	GLint internal_format = GL_RGBA8;
+	GLenum format = GL_RGBA;
+	GLenum type = GL_UNSIGNED_BYTE;
+	GLint swizzle[4] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+	//rows are tightly packed, so this is the largest alignment (up to 8) every row start has:
+	GLint unpack_alignment = 4;
+};
+
+TextureFormat texture_format(PngImage const &image);
+
+//allocate level 0 of the bound GL_TEXTURE_2D for 'image' (contents undefined) and set its swizzle;
+//returns the format to upload rows with (glPixelStorei(GL_UNPACK_ALIGNMENT, ...) is left to the caller):
+TextureFormat texture_allocate(PngImage const &image);
@@ -0,0 +1,64 @@
+#include "texture_pages.hpp"
+
+#include <algorithm>
+
+TexturePages::~TexturePages() {
+	if (!textures.empty()) glDeleteTextures(GLsizei(textures.size()), textures.data());
+}
+
+void TexturePages::allocate(glm::uvec2 const &size_) {
+	if (!textures.empty()) glDeleteTextures(GLsizei(textures.size()), textures.data());
+	textures.clear();
+
+	size = size_;
+	uint32_t max_size = max_page_size;
+	if (max_size == 0) {
+		GLint gl_max = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &gl_max);
+		max_size = uint32_t(std::max(gl_max, 1));
+	}
+	page_size = glm::min(size, glm::uvec2(max_size));
+	pages = glm::uvec2(0,0);
+	if (size.x == 0 || size.y == 0) return;
+	pages = (size + page_size - glm::uvec2(1)) / page_size;
+
+	textures.resize(pages.x * pages.y);
+	glGenTextures(GLsizei(textures.size()), textures.data());
+	for (uint32_t py = 0; py < pages.y; ++py) {
+		for (uint32_t px = 0; px < pages.x; ++px) {
+			glm::uvec2 extent = glm::min(page_size, size - glm::uvec2(px, py) * page_size);
+			glBindTexture(GL_TEXTURE_2D, textures[py * pages.x + px]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, extent.x, extent.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		}
+	}
+}
+
+void TexturePages::upload(uint32_t y, uint32_t count, uint32_t const *rows) {
+	if (textures.empty()) return;
+	//rows are full width, so each page's part of them is a sub-rectangle:
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, size.x);
+	for (uint32_t row = y; row < y + count; ) {
+		uint32_t py = row / page_size.y;
+		uint32_t page_end = std::min((py + 1) * page_size.y, size.y);
+		uint32_t rows_here = std::min(y + count, page_end) - row;
+		for (uint32_t px = 0; px < pages.x; ++px) {
+			uint32_t x = px * page_size.x;
+			uint32_t width = std::min(page_size.x, size.x - x);
+			glBindTexture(GL_TEXTURE_2D, textures[py * pages.x + px]);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row - py * page_size.y, width, rows_here, GL_RGBA, GL_UNSIGNED_BYTE, rows + size_t(row - y) * size.x + x);
+		}
+		row += rows_here;
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+GLuint TexturePages::page_at(glm::uvec2 const &at, glm::uvec2 *local) const {
+	if (textures.empty() || at.x >= size.x || at.y >= size.y) return 0;
+	glm::uvec2 page = at / page_size;
+	if (local) *local = at - page * page_size;
+	return textures[page.y * pages.x + page.x];
+}
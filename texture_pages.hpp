@@ -0,0 +1,38 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+/*
+ * An RGBA8 image split across several textures ("pages"), for images bigger than GL_MAX_TEXTURE_SIZE.
+ * Pages are page_size pixels (the last column and row of pages may be smaller) and are laid out from
+ * the lower-left corner; they are filled a band of rows at a time (see AssetLoader::load_texture_pages).
+ * Like the game's main texture, pages clamp to edge and sample with GL_NEAREST.
+ */
+
+struct TexturePages {
+	TexturePages() = default;
+	~TexturePages();
+	TexturePages(TexturePages const &) = delete;
+	TexturePages &operator=(TexturePages const &) = delete;
+
+	//largest page side; 0 means GL_MAX_TEXTURE_SIZE:
+	uint32_t max_page_size = 0;
+
+	glm::uvec2 size = glm::uvec2(0,0); //whole image, in pixels
+	glm::uvec2 page_size = glm::uvec2(0,0);
+	glm::uvec2 pages = glm::uvec2(0,0); //across, up
+	std::vector< GLuint > textures; //page (x,y) is textures[y * pages.x + x]
+
+	//GL thread: (re)create empty pages for an image of 'size':
+	void allocate(glm::uvec2 const &size);
+	//GL thread: copy rows y .. y+count-1 ('size.x' pixels each, from row y up) into the pages they cross:
+	void upload(uint32_t y, uint32_t count, uint32_t const *rows);
+
+	//texture of the page holding pixel 'at' (and, if 'local' is given, 'at' relative to that page):
+	GLuint page_at(glm::uvec2 const &at, glm::uvec2 *local = nullptr) const;
+};
@@ -0,0 +1,92 @@
+#include "vertex_stream.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <cassert>
+
+VertexStream::VertexStream(GLsizei stride_, size_t region_bytes_, unsigned int regions) : stride(stride_) {
+	assert(stride > 0);
+	assert(regions > 0);
+	fences.assign(regions, 0);
+	glGenBuffers(1, &buffer);
+	grow(region_bytes_);
+	//start on the last region so the first map() uses region 0:
+	current = regions - 1;
+}
+
+VertexStream::~VertexStream() {
+	for (auto &f : fences) {
+		if (f) glDeleteSync(f);
+		f = 0;
+	}
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+void VertexStream::grow(size_t bytes) {
+	//regions are kept a multiple of the stride so region starts are vertex indices:
+	size_t new_bytes = (region_bytes ? region_bytes : size_t(stride));
+	while (new_bytes < bytes) new_bytes *= 2;
+	new_bytes = ((new_bytes + stride - 1) / stride) * stride;
+
+	//re-specifying the store orphans the old one, so pending fences no longer matter:
+	for (auto &f : fences) {
+		if (f) glDeleteSync(f);
+		f = 0;
+	}
+	region_bytes = new_bytes;
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, region_bytes * fences.size(), NULL, GL_STREAM_DRAW);
+}
+
+void *VertexStream::map(size_t count) {
+	assert(!mapped);
+	//any draws reading the previous region have been issued by now, so fence it:
+	if (pending) {
+		assert(fences[current] == 0);
+		fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pending = false;
+	}
+
+	size_t bytes = count * stride;
+	if (bytes > region_bytes) {
+		grow(bytes);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	}
+
+	current = (current + 1) % fences.size();
+
+	//wait for the GPU to be done with this region:
+	if (fences[current]) {
+		while (true) {
+			GLenum ret = glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			if (ret == GL_ALREADY_SIGNALED || ret == GL_CONDITION_SATISFIED) break;
+			if (ret == GL_WAIT_FAILED) {
+				std::cerr << "WARNING: wait on vertex stream fence failed." << std::endl;
+				break;
+			}
+		}
+		glDeleteSync(fences[current]);
+		fences[current] = 0;
+	}
+
+	if (bytes == 0) bytes = stride; //mapping an empty range is an error
+	void *ptr = glMapBufferRange(GL_ARRAY_BUFFER, current * region_bytes, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	if (!ptr) throw std::runtime_error("Failed to map vertex stream region.");
+	mapped = true;
+	return ptr;
+}
+
+GLint VertexStream::unmap() {
+	assert(mapped);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE) {
+		//store was lost (e.g., display mode change); contents of this region are undefined for one frame:
+		std::cerr << "WARNING: vertex stream region was corrupted while mapped." << std::endl;
+	}
+	mapped = false;
+	pending = true;
+	return GLint((current * region_bytes) / stride);
+}
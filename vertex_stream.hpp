@@ -0,0 +1,39 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <vector>
+#include <stddef.h>
+
+/*
+ * Streaming vertex buffer.
+ * One GL buffer is split into 'regions' equally-sized regions which are used round-robin,
+ * one per map()/unmap() pair. Regions are written through an unsynchronized mapping and
+ * guarded by a fence, so the driver never has to orphan or reallocate storage per frame.
+ * The buffer grows (and is re-specified once) whenever a request doesn't fit in a region.
+ */
+
+struct VertexStream {
+	VertexStream(GLsizei stride, size_t region_bytes = 64 * 1024, unsigned int regions = 3);
+	~VertexStream();
+	VertexStream(VertexStream const &) = delete;
+	VertexStream &operator=(VertexStream const &) = delete;
+
+	//map space for 'count' vertices in the next free region (leaves buffer bound to GL_ARRAY_BUFFER):
+	void *map(size_t count);
+	//finish writing the mapped region; returns the index of its first vertex (for glDrawArrays):
+	GLint unmap();
+
+	GLuint buffer = 0;
+	GLsizei stride = 0;
+	size_t region_bytes = 0;
+
+private:
+	void grow(size_t bytes);
+	//fences guarding each region; 0 means the region is not in flight:
+	std::vector< GLsync > fences;
+	unsigned int current = 0;
+	bool mapped = false;
+	//region 'current' has been handed out but not yet fenced:
+	bool pending = false;
+};